@@ -0,0 +1,81 @@
+// bench_pid_manager.cpp
+// Compares the storage engines at several fill ratios:
+//   next_free       - find-next-free from a random PID
+//   next_allocated  - successor query from a random PID
+//   churn           - release 64 random live PIDs, then allocate 64 again
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <random>
+#include <vector>
+#include "pid_manager.hpp"
+#include "trie_storage.hpp"
+#include "sparse_storage.hpp"
+
+static const int kMin = 0;
+static const int kMax = (1 << 22) - 1;
+static const int kQueries = 200000;
+static const int kChurnRounds = 2000;
+static const int kBatch = 64;
+
+template <typename Fn>
+static double ns_per_op(int ops, Fn fn) {
+    auto t0 = std::chrono::steady_clock::now();
+    fn();
+    auto t1 = std::chrono::steady_clock::now();
+    return std::chrono::duration<double, std::nano>(t1 - t0).count() / ops;
+}
+
+template <typename Manager>
+static void bench(const char* name, double fill) {
+    Manager m(kMin, kMax);
+    if (m.allocate_map() != 1) {
+        std::printf("%-8s allocate_map failed\n", name);
+        return;
+    }
+
+    // Fill completely, then free a random subset down to the target ratio.
+    std::vector<int> live;
+    live.reserve(static_cast<size_t>(kMax - kMin + 1));
+    for (int pid = m.allocate_pid(); pid != -1; pid = m.allocate_pid()) live.push_back(pid);
+    std::mt19937 rng(2024);
+    std::shuffle(live.begin(), live.end(), rng);
+    size_t keep = static_cast<size_t>(fill * static_cast<double>(live.size()));
+    for (size_t i = keep; i < live.size(); ++i) m.release_pid(live[i]);
+    live.resize(keep);
+
+    std::uniform_int_distribution<int> any(kMin, kMax);
+    std::vector<int> queries(kQueries);
+    for (int& q : queries) q = any(rng);
+
+    long sink = 0;
+    double nf = ns_per_op(kQueries, [&] { for (int q : queries) sink += m.next_free(q); });
+    double na = ns_per_op(kQueries, [&] { for (int q : queries) sink += m.next_allocated(q); });
+    double churn = ns_per_op(kChurnRounds * kBatch, [&] {
+        for (int r = 0; r < kChurnRounds; ++r) {
+            for (int i = 0; i < kBatch; ++i) {
+                size_t k = rng() % live.size();
+                m.release_pid(live[k]);
+                live[k] = live.back();
+                live.pop_back();
+            }
+            for (int i = 0; i < kBatch; ++i) live.push_back(m.allocate_pid());
+        }
+    });
+
+    std::printf("%-8s fill=%6.3f  next_free %9.1f ns  next_allocated %9.1f ns  churn %9.1f ns/pid  (%ld)\n",
+                name, fill, nf, na, churn, sink & 1);
+}
+
+int main() {
+    std::printf("PID range [%d, %d]\n", kMin, kMax);
+    const double fills[] = {0.5, 0.9, 0.99, 0.999};
+    for (double fill : fills) {
+        bench<ByteMapPIDManager>("bytemap", fill);
+        bench<BitmapPIDManager>("bitmap", fill);
+        bench<TriePIDManager>("trie", fill);
+        bench<SparsePIDManager>("sparse", fill);
+        std::printf("\n");
+    }
+    return 0;
+}
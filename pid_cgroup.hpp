@@ -0,0 +1,89 @@
+#pragma once
+#include <atomic>
+#include <deque>
+#include <cstddef>
+#include <cstdint>
+
+// cgroup-style hierarchical PID limits (the pids controller's pids.max).
+//
+// Groups form a tree rooted at group 0. Charging a PID to a group adds one
+// to the usage of the group and every ancestor; if any of them would go over
+// its limit the charge is undone on the levels already charged and refused.
+// Usage, limits and the failure counters are atomics, so charging takes no
+// lock and groups can be shared by several managers (one per namespace, say).
+//
+// A manager with limits attached charges before it scans the map, so a
+// group at its limit is turned away after a few atomic adds.
+//
+// create() is not safe against concurrent charging; build the tree first.
+class PIDLimitGroups {
+public:
+    static constexpr std::int64_t kUnlimited = INT64_MAX;
+
+    PIDLimitGroups() { groups.emplace_back(-1, kUnlimited); }
+
+    // Creates a child group of `parent`. Returns its id, or -1 if the
+    // parent doesn't exist or the limit is negative.
+    int create(int parent, std::int64_t limit = kUnlimited) {
+        if (!valid(parent) || limit < 0) return -1;
+        groups.emplace_back(parent, limit);
+        return static_cast<int>(groups.size() - 1);
+    }
+
+    // Charges n PIDs to `id` and its ancestors. Returns false, charging
+    // nothing, if the group is invalid or any level would exceed its limit.
+    bool try_charge(int id, std::int64_t n = 1) {
+        if (!valid(id)) return false;
+        for (int g = id; g != -1; g = at(g).parent) {
+            Group& grp = at(g);
+            std::int64_t now = grp.usage.fetch_add(n, std::memory_order_relaxed) + n;
+            if (now > grp.limit.load(std::memory_order_relaxed)) {
+                grp.usage.fetch_sub(n, std::memory_order_relaxed);
+                grp.events.fetch_add(1, std::memory_order_relaxed);
+                for (int u = id; u != g; u = at(u).parent) {
+                    at(u).usage.fetch_sub(n, std::memory_order_relaxed);
+                }
+                return false;
+            }
+        }
+        return true;
+    }
+
+    // Gives back n PIDs charged to `id`.
+    void uncharge(int id, std::int64_t n = 1) {
+        if (!valid(id)) return;
+        for (int g = id; g != -1; g = at(g).parent) {
+            at(g).usage.fetch_sub(n, std::memory_order_relaxed);
+        }
+    }
+
+    // Like writing pids.max: a limit below the current usage doesn't take
+    // PIDs away, it only refuses new charges. Returns 1, or -1 on bad input.
+    int set_limit(int id, std::int64_t limit) {
+        if (!valid(id) || limit < 0) return -1;
+        at(id).limit.store(limit, std::memory_order_relaxed);
+        return 1;
+    }
+
+    std::int64_t limit(int id) const { return valid(id) ? at(id).limit.load(std::memory_order_relaxed) : -1; }
+    std::int64_t usage(int id) const { return valid(id) ? at(id).usage.load(std::memory_order_relaxed) : -1; }
+    // Charges refused because this group was at its limit (pids.events).
+    std::uint64_t events(int id) const { return valid(id) ? at(id).events.load(std::memory_order_relaxed) : 0; }
+    int parent(int id) const { return valid(id) ? at(id).parent : -1; }
+    std::size_t size() const { return groups.size(); }
+
+private:
+    struct Group {
+        Group(int p, std::int64_t l) : parent(p), usage(0), limit(l), events(0) {}
+        int parent;
+        std::atomic<std::int64_t> usage;
+        std::atomic<std::int64_t> limit;
+        std::atomic<std::uint64_t> events;
+    };
+
+    bool valid(int id) const { return id >= 0 && static_cast<std::size_t>(id) < groups.size(); }
+    Group& at(int id) { return groups[static_cast<std::size_t>(id)]; }
+    const Group& at(int id) const { return groups[static_cast<std::size_t>(id)]; }
+
+    std::deque<Group> groups; // deque: atomics can't move, and ids stay stable
+};
@@ -0,0 +1,167 @@
+#pragma once
+#include <vector>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <algorithm>
+#include "pid_protocol.hpp"
+
+// Client side of the PID service, with a local pool of PIDs leased from the
+// server in blocks.
+//
+// allocate() pops the pool and release() pushes onto it, so almost every
+// call is a few nanoseconds and no syscall. When the pool runs down to a
+// quarter of a block, the next block is requested without waiting for it;
+// by the time the pool is empty the reply is usually already buffered and
+// costs one read(). Each block is sized to last about kRefillInterval at
+// the allocation rate (a moving average), within [kMinBlock, kMaxBlock].
+// The rate is only sampled over at least kRefillInterval, so a short burst
+// can't pass for a high rate and lease a large block it never uses; the
+// ceiling keeps one client from draining a small PID space even when its
+// rate is genuinely high. Released PIDs are reused locally; once more than
+// two blocks pile up the excess goes back to the server in one frame, and
+// finish() returns whatever is left.
+//
+// Pooled PIDs belong to this client's owner id in the server, so PIDs a
+// crashed client was holding stay taken until the server reclaims that owner
+// (PIDServer does when it watches the client process).
+class PIDClient {
+public:
+    static constexpr std::size_t kMinBlock = 8;
+    static constexpr std::size_t kMaxBlock = 128;
+    static_assert(kMaxBlock <= pid_protocol::kMaxBatch, "a block is one kAlloc frame");
+    static constexpr std::chrono::nanoseconds kRefillInterval = std::chrono::milliseconds(10);
+
+    // Talks over a request/reply fd pair (a pipe pair, or one socket given
+    // twice). The fds stay the caller's.
+    PIDClient(int request_fd, int reply_fd) : req(request_fd), rep(reply_fd) {}
+
+    // Returns a PID, or -1 if the server has none left or the connection
+    // failed.
+    int allocate() {
+        if (pool.empty() && refill() == -1) return -1;
+        int pid = pool.back();
+        pool.pop_back();
+        ++handed_out;
+        if (in_flight == 0 && pool.size() <= block / 4) prefetch();
+        return pid;
+    }
+
+    // Gives a PID back to the pool. Returns 1, or -1 if returning the
+    // excess to the server failed.
+    int release(int pid) {
+        pool.push_back(pid);
+        return pool.size() > 2 * block ? give_back(pool.size() - block) : 1;
+    }
+
+    // Returns every pooled PID (waiting for a block still in flight) and
+    // says Done. The client can't be used afterwards. Returns 1, or -1.
+    int finish() {
+        while (in_flight != 0) {
+            if (wait_reply() == -1) return -1;
+        }
+        out.clear();
+        append_release(pool.size());
+        pid_protocol::append(out, pid_protocol::kDone, 0, nullptr, next_id++);
+        return send();
+    }
+
+    std::size_t pooled() const { return pool.size(); }
+    // PIDs the next refill will ask for.
+    std::size_t block_size() const { return block; }
+    // Times allocate() found the pool empty and had to wait on the server.
+    std::uint64_t stalls() const { return stall_count; }
+    // kAlloc requests sent.
+    std::uint64_t refills() const { return refill_count; }
+
+private:
+    // Asks for the next block without waiting. The block size is set from
+    // the rate over the last sample window, once one has closed.
+    int prefetch() {
+        auto now = std::chrono::steady_clock::now();
+        if (refill_count == 0) {
+            sampled_at = now;
+            handed_at_sample = handed_out;
+        } else if (now - sampled_at >= kRefillInterval) {
+            double secs = std::chrono::duration<double>(now - sampled_at).count();
+            double rate = static_cast<double>(handed_out - handed_at_sample) / secs;
+            avg_rate = avg_rate == 0 ? rate : (3 * avg_rate + rate) / 4;
+            double want = avg_rate * std::chrono::duration<double>(kRefillInterval).count();
+            std::size_t b = kMinBlock;
+            while (b < kMaxBlock && static_cast<double>(b) < want) b *= 2;
+            block = b;
+            sampled_at = now;
+            handed_at_sample = handed_out;
+        }
+        ++refill_count;
+        if (next_id == 0) next_id = 1; // 0 means "none in flight"
+        in_flight = next_id++;
+        out.clear();
+        pid_protocol::append(out, pid_protocol::kAlloc, block, nullptr, in_flight);
+        if (send() == 1) return 1;
+        in_flight = 0;
+        return -1;
+    }
+
+    // The pool is empty: make sure a block is on its way and wait for it.
+    int refill() {
+        if (in_flight == 0 && prefetch() == -1) return -1;
+        ++stall_count;
+        while (pool.empty()) {
+            if (in_flight == 0) return -1; // the server had nothing to give
+            if (wait_reply() == -1) return -1;
+        }
+        return 1;
+    }
+
+    // Blocks until one reply frame arrives and takes in its PIDs.
+    int wait_reply() {
+        pid_protocol::Header h{};
+        int got;
+        while ((got = in.next(h, pids)) == 0) {
+            if (in.read_from(rep) <= 0) return -1;
+        }
+        if (got == -1 || h.op != pid_protocol::kPids) return -1;
+        if (h.id == in_flight) in_flight = 0;
+        pool.insert(pool.end(), pids.rbegin(), pids.rend()); // handed out lowest first
+        return 1;
+    }
+
+    int give_back(std::size_t n) {
+        out.clear();
+        append_release(n);
+        return send();
+    }
+
+    // Moves the last n pooled PIDs into kRelease frames in `out`.
+    void append_release(std::size_t n) {
+        while (n > 0) {
+            std::size_t k = std::min(n, pid_protocol::kMaxBatch);
+            pid_protocol::append(out, pid_protocol::kRelease, k, &pool[pool.size() - k], next_id++);
+            pool.resize(pool.size() - k);
+            n -= k;
+        }
+    }
+
+    // One write of `out`: a sendmmsg of datagrams on a socket.
+    int send() {
+        if (req == rep) return pid_protocol::send_frames(req, out);
+        return pid_protocol::write_all(req, out.data(), out.size());
+    }
+
+    int req;
+    int rep;
+    std::vector<int> pool;
+    std::vector<int> pids;           // scratch for decoded replies
+    std::vector<char> out;
+    pid_protocol::Decoder in;
+    std::uint32_t next_id = 1;
+    std::uint32_t in_flight = 0;     // id of the kAlloc awaiting its reply, or 0
+    std::size_t block = kMinBlock;
+    double avg_rate = 0;             // PIDs handed out per second
+    std::chrono::steady_clock::time_point sampled_at; // start of the current rate sample
+    std::uint64_t handed_out = 0;
+    std::uint64_t handed_at_sample = 0;
+    std::uint64_t refill_count = 0;
+    std::uint64_t stall_count = 0;
+};
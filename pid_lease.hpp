@@ -0,0 +1,235 @@
+#pragma once
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+#include "pid_manager.hpp"
+
+// Lease mode: PIDs handed out with a time-to-live. A client that stops
+// renewing (because it crashed, say) loses its PIDs when the lease runs out,
+// instead of holding them until someone calls release_pid.
+//
+// Expiry runs on a hierarchical timer wheel: 4 levels of 64 buckets
+// (2^24 ticks), plus an overflow bucket for leases further out than the
+// current top-level span. A lease sits in the level whose span first covers
+// its expiry relative to now, and is pushed down one level each time that
+// bucket comes due, so inserting, renewing, cancelling and expiring are all
+// O(1) per lease and the PID table is never scanned. A 64-bit occupancy
+// mask per level lets advance() jump straight to the next bucket that has
+// something in it, so time passing costs nothing while no lease is due.
+//
+// Time is in caller-chosen ticks (e.g. milliseconds) and only moves
+// through advance(). Leased PIDs must be given back through release(), not
+// directly through the manager, or an expiry could free a reused PID.
+template <typename Storage>
+class BasicPIDLeases {
+public:
+    explicit BasicPIDLeases(BasicPIDManager<Storage>& manager, std::uint64_t start = 0)
+        : mgr(manager), now_(start), count_(0) {
+        heads.assign(kBuckets, kNil);
+    }
+
+    // Allocates a PID whose lease expires `ttl` ticks from now (ttl >= 1).
+    // Returns -1 if the manager can't allocate.
+    int acquire(std::uint64_t ttl, std::uint32_t owner = 0) {
+        int pid = mgr.allocate_pid_for(owner);
+        if (pid != -1) start_lease(pid, ttl);
+        return pid;
+    }
+
+    // Allocates n leased PIDs at once, all or nothing (see allocate_atomic).
+    // Returns 1 on success, -1 if fewer than n PIDs are free.
+    int acquire_many(int n, std::uint64_t ttl, std::vector<int>& pids, std::uint32_t owner = 0) {
+        std::size_t first = pids.size();
+        if (mgr.allocate_atomic(n, pids, owner) != 1) return -1;
+        for (std::size_t i = first; i < pids.size(); ++i) start_lease(pids[i], ttl);
+        return 1;
+    }
+
+    // Pushes a lease's expiry to `ttl` ticks from now.
+    // Returns 1 on success, -1 if the PID isn't leased.
+    int renew(int pid, std::uint64_t ttl) {
+        if (!leased(pid)) return -1;
+        std::uint32_t idx = index_of(pid);
+        unlink(idx);
+        expiry[idx] = now_ + (ttl == 0 ? 1 : ttl);
+        insert(idx);
+        return 1;
+    }
+
+    // Renews a batch of leases in one call. Returns how many were renewed.
+    std::size_t renew(const std::vector<int>& pids, std::uint64_t ttl) {
+        std::size_t renewed = 0;
+        for (int pid : pids) renewed += renew(pid, ttl) == 1;
+        return renewed;
+    }
+
+    // Ends a lease early and releases its PID. Safe no-op if not leased.
+    void release(int pid) {
+        if (!leased(pid)) return;
+        unlink(index_of(pid));
+        --count_;
+        mgr.release_pid(pid);
+    }
+
+    // Moves time forward to `to`, releasing every PID whose lease expired.
+    // Expired PIDs are appended to `expired` when given. Returns how many
+    // leases expired. Only ticks where a bucket expires or cascades are
+    // visited, however far `to` is.
+    std::size_t advance(std::uint64_t to, std::vector<int>* expired = nullptr) {
+        std::size_t reclaimed = 0;
+        while (now_ < to) {
+            std::uint64_t at = count_ == 0 ? ~std::uint64_t(0) : next_event();
+            if (at > to) {
+                now_ = to; // nothing due on the way: every lease keeps its bucket
+                break;
+            }
+            now_ = at;
+            reclaimed += tick(expired);
+        }
+        return reclaimed;
+    }
+
+    bool leased(int pid) const {
+        if (pid < mgr.min()) return false;
+        std::size_t idx = static_cast<std::size_t>(pid - mgr.min());
+        return idx < bucket.size() && bucket[idx] != kNone;
+    }
+
+    // Expiry tick of a leased PID, or 0 if it isn't leased.
+    std::uint64_t expires_at(int pid) const { return leased(pid) ? expiry[index_of(pid)] : 0; }
+
+    std::uint64_t now() const { return now_; }
+    std::size_t size() const { return count_; }
+
+private:
+    static constexpr unsigned kBits = 6;
+    static constexpr unsigned kLevels = 4;
+    static constexpr std::uint32_t kSlots = 1u << kBits;
+    static constexpr std::uint32_t kOverflow = kLevels * kSlots;
+    static constexpr std::uint32_t kBuckets = kOverflow + 1;
+    static constexpr unsigned kSpanBits = kBits * kLevels;
+    static constexpr std::uint32_t kNil = 0xFFFFFFFFu;
+    static constexpr std::uint16_t kNone = 0xFFFF;
+
+    std::uint32_t index_of(int pid) const { return static_cast<std::uint32_t>(pid - mgr.min()); }
+
+    void start_lease(int pid, std::uint64_t ttl) {
+        std::size_t idx = index_of(pid);
+        if (idx >= bucket.size()) {
+            resize_amortized(expiry, idx + 1);
+            resize_amortized(next, idx + 1);
+            resize_amortized(prev, idx + 1);
+            std::size_t old = bucket.size();
+            resize_amortized(bucket, idx + 1);
+            for (std::size_t i = old; i < bucket.size(); ++i) bucket[i] = kNone;
+        }
+        expiry[idx] = now_ + (ttl == 0 ? 1 : ttl);
+        insert(static_cast<std::uint32_t>(idx));
+        ++count_;
+    }
+
+    // Level = lowest level whose parent block contains both now and the
+    // expiry; the bucket is the expiry's digit at that level.
+    void insert(std::uint32_t idx) {
+        std::uint64_t e = expiry[idx];
+        std::uint32_t b = kOverflow;
+        if ((e >> kSpanBits) == (now_ >> kSpanBits)) {
+            unsigned level = 0;
+            while ((e >> (kBits * (level + 1))) != (now_ >> (kBits * (level + 1)))) ++level;
+            b = level * kSlots + static_cast<std::uint32_t>((e >> (kBits * level)) & (kSlots - 1));
+        }
+        bucket[idx] = static_cast<std::uint16_t>(b);
+        prev[idx] = kNil;
+        next[idx] = heads[b];
+        if (heads[b] != kNil) prev[heads[b]] = idx;
+        heads[b] = idx;
+        if (b != kOverflow) occupied[b / kSlots] |= std::uint64_t(1) << (b % kSlots);
+    }
+
+    void unlink(std::uint32_t idx) {
+        std::uint32_t b = bucket[idx];
+        if (prev[idx] != kNil) next[prev[idx]] = next[idx];
+        else heads[b] = next[idx];
+        if (next[idx] != kNil) prev[next[idx]] = prev[idx];
+        bucket[idx] = kNone;
+        if (heads[b] == kNil) empty(b);
+    }
+
+    void empty(std::uint32_t b) {
+        heads[b] = kNil;
+        if (b != kOverflow) occupied[b / kSlots] &= ~(std::uint64_t(1) << (b % kSlots));
+    }
+
+    // The first tick after now at which tick() has something to do: a
+    // non-empty level-0 bucket comes due, or a non-empty higher bucket (or
+    // the overflow bucket) cascades. Every bucket at level L holds a digit
+    // above now's digit at L, so each level's candidate is the lowest set
+    // bit above that digit, placed within now's block at the next level up.
+    std::uint64_t next_event() const {
+        std::uint64_t best = ~std::uint64_t(0);
+        for (unsigned level = 0; level < kLevels; ++level) {
+            unsigned shift = kBits * level;
+            unsigned digit = static_cast<unsigned>((now_ >> shift) & (kSlots - 1));
+            std::uint64_t later = digit + 1 == kSlots ? 0 : occupied[level] & (~std::uint64_t(0) << (digit + 1));
+            if (later == 0) continue;
+            std::uint64_t block = (now_ >> (shift + kBits)) << (shift + kBits);
+            std::uint64_t at = block + (static_cast<std::uint64_t>(__builtin_ctzll(later)) << shift);
+            if (at < best) best = at;
+        }
+        if (heads[kOverflow] != kNil) {
+            std::uint64_t at = ((now_ >> kSpanBits) + 1) << kSpanBits;
+            if (at < best) best = at;
+        }
+        return best;
+    }
+
+    // Re-files every lease in bucket b relative to the current time.
+    void cascade(std::uint32_t b) {
+        std::uint32_t idx = heads[b];
+        empty(b);
+        while (idx != kNil) {
+            std::uint32_t following = next[idx];
+            insert(idx);
+            idx = following;
+        }
+    }
+
+    std::size_t tick(std::vector<int>* expired) {
+        // Higher levels first: what they hand down may be due this tick.
+        if ((now_ & ((std::uint64_t(1) << kSpanBits) - 1)) == 0) cascade(kOverflow);
+        for (unsigned level = kLevels - 1; level >= 1; --level) {
+            if ((now_ & ((std::uint64_t(1) << (kBits * level)) - 1)) == 0) {
+                cascade(level * kSlots + static_cast<std::uint32_t>((now_ >> (kBits * level)) & (kSlots - 1)));
+            }
+        }
+
+        std::uint32_t b = static_cast<std::uint32_t>(now_ & (kSlots - 1));
+        std::size_t reclaimed = 0;
+        std::uint32_t idx = heads[b];
+        empty(b);
+        while (idx != kNil) {
+            std::uint32_t following = next[idx];
+            bucket[idx] = kNone;
+            int pid = mgr.min() + static_cast<int>(idx);
+            mgr.release_pid(pid);
+            if (expired) expired->push_back(pid);
+            --count_;
+            ++reclaimed;
+            idx = following;
+        }
+        return reclaimed;
+    }
+
+    BasicPIDManager<Storage>& mgr;
+    std::uint64_t now_;
+    std::size_t count_;
+    // Per-PID lease state, indexed by pid - min; linked into buckets by index.
+    std::vector<std::uint64_t> expiry;
+    std::vector<std::uint32_t> next;
+    std::vector<std::uint32_t> prev;
+    std::vector<std::uint16_t> bucket;  // kNone when not leased
+    std::vector<std::uint32_t> heads;   // first lease in each bucket
+    std::uint64_t occupied[kLevels] = {}; // per level: bit d set if bucket d is non-empty
+};
+
+using PIDLeases = BasicPIDLeases<BitmapStorage>;
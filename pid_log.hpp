@@ -0,0 +1,239 @@
+#pragma once
+#include <atomic>
+#include <thread>
+#include <climits>
+#include <memory>
+#include <ostream>
+#include <string>
+#include <cstddef>
+#include <cstdint>
+#include <stdexcept>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+#include "pid_protocol.hpp"
+
+// Binary event log for the PID service.
+//
+// The request path must not format or write: at load a server doing
+// `std::cout << ...` per frame spends more time in iostreams and write()
+// than allocating. Here a producer copies a fixed 20-byte Record into a
+// bounded lock-free ring and returns; a background thread turns records
+// into text and writes them to the stream in large batches.
+//
+// The ring is a sequence-numbered array of cells (Vyukov's bounded queue):
+// a producer claims a cell with one CAS on the tail, fills it and publishes
+// it by storing its sequence number with release order, so any number of
+// servers may share one log. Only the formatter thread consumes. When the
+// ring is full the record is dropped and counted, never waited for.
+//
+// The formatter sleeps on a futex once it finds the ring empty: it raises
+// its "sleeping" word, checks the ring once more, then waits. A producer
+// checks that word after publishing and makes the FUTEX_WAKE only when it
+// is set, so a busy log costs producers no syscalls and an idle one costs
+// the formatter none. flush() waits the same way for the formatter.
+//
+// Two controls keep the volume down: a level (kDebug logs every request,
+// kInfo only client exits, kOff nothing) and a sampling rate that keeps one
+// request in every n. Both are checked with relaxed loads before any
+// record is built.
+//
+// The formatter writes to the stream from its own thread: don't use that
+// stream elsewhere without flush() first. Don't fork() while a log exists:
+// the child gets no formatter, and the parent's may hold the stream's lock
+// at that moment. Construct it once the children are forked.
+namespace pid_log {
+
+enum Level : std::uint8_t { kDebug = 0, kInfo = 1, kOff = 2 };
+
+// kAlloc, kRelease and kDone are request records; kExit is a client process
+// that exited (a = PIDs reclaimed).
+enum Kind : std::uint32_t { kAlloc = pid_protocol::kAlloc, kRelease = pid_protocol::kRelease,
+                            kDone = pid_protocol::kDone, kExit = 16 };
+
+struct Record {
+    std::uint32_t kind;
+    std::uint32_t client;
+    std::uint32_t request;
+    std::uint32_t a;       // PIDs asked for or released, or reclaimed
+    std::uint32_t b;       // PIDs granted
+};
+
+class EventLog {
+public:
+    // Starts the formatter thread writing to `out`. `capacity` (records) is
+    // rounded up to a power of two.
+    explicit EventLog(std::ostream& out, std::size_t capacity = 4096) : sink(out) {
+        if (capacity == 0 || capacity > (std::size_t(1) << 24)) throw std::invalid_argument("EventLog capacity");
+        while (cap < capacity) cap <<= 1;
+        mask = cap - 1;
+        cells.reset(new Cell[cap]);
+        for (std::size_t i = 0; i < cap; ++i) cells[i].seq.store(i, std::memory_order_relaxed);
+        formatter = std::thread([this] { format_loop(); });
+    }
+
+    // Writes out everything logged so far and stops the formatter.
+    ~EventLog() {
+        stopping.store(true, std::memory_order_release);
+        wake_if_sleeping(sleeping);
+        formatter.join();
+    }
+
+    EventLog(const EventLog&) = delete;
+    EventLog& operator=(const EventLog&) = delete;
+
+    void set_level(Level l) { level.store(l, std::memory_order_relaxed); }
+    // Keeps one request record in every `n` (1: all of them).
+    void set_sampling(std::uint32_t n) { sample_every.store(n == 0 ? 1 : n, std::memory_order_relaxed); }
+
+    bool enabled(Level l) const { return l >= level.load(std::memory_order_relaxed); }
+
+    // One served request. `granted` only means something for kAlloc.
+    void request(std::uint32_t client, std::uint32_t id, std::uint8_t op, std::uint32_t count,
+                 std::uint32_t granted = 0) {
+        if (!enabled(kDebug)) return;
+        std::uint32_t n = sample_every.load(std::memory_order_relaxed);
+        if (n > 1 && sampled.fetch_add(1, std::memory_order_relaxed) % n != 0) return;
+        push(Record{op, client, id, count, granted});
+    }
+
+    // A client's process exited and `reclaimed` PIDs it held were freed.
+    void exited(std::uint32_t client, std::uint32_t reclaimed) {
+        if (enabled(kInfo)) push(Record{kExit, client, 0, reclaimed, 0});
+    }
+
+    // Blocks until every record logged before the call has been written
+    // and the stream flushed.
+    void flush() {
+        std::uint64_t upto = tail.load(std::memory_order_acquire);
+        while (written.load(std::memory_order_acquire) < upto) {
+            flushing.store(1, std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            if (written.load(std::memory_order_acquire) >= upto) break;
+            futex_wait(flushing);
+        }
+    }
+
+    // Records lost to a full ring.
+    std::uint64_t dropped() const { return lost.load(std::memory_order_relaxed); }
+    // Records written to the stream.
+    std::uint64_t logged() const { return written.load(std::memory_order_relaxed); }
+
+private:
+    using Word = std::atomic<std::uint32_t>;
+
+    // Private futex ops: the words never leave this process.
+    static void futex_wait(Word& word) {
+        syscall(SYS_futex, reinterpret_cast<std::uint32_t*>(&word), FUTEX_WAIT_PRIVATE, 1, nullptr, nullptr, 0);
+    }
+
+    // Clears a waiter's flag and wakes every thread on it, if any waits.
+    // The fence orders the caller's publish before the flag check, as in
+    // pid_shm::wake_if_sleeping.
+    static void wake_if_sleeping(Word& word) {
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (word.load(std::memory_order_relaxed) != 0) {
+            word.store(0, std::memory_order_relaxed);
+            syscall(SYS_futex, reinterpret_cast<std::uint32_t*>(&word), FUTEX_WAKE_PRIVATE, INT_MAX, nullptr, nullptr, 0);
+        }
+    }
+
+    bool ready() const { return cells[head & mask].seq.load(std::memory_order_acquire) == head + 1; }
+
+    struct Cell {
+        std::atomic<std::uint64_t> seq{0}; // == position: free; position + 1: filled
+        Record rec;
+    };
+
+    void push(const Record& r) {
+        std::uint64_t pos = tail.load(std::memory_order_relaxed);
+        Cell* c;
+        for (;;) {
+            c = &cells[pos & mask];
+            std::uint64_t seq = c->seq.load(std::memory_order_acquire);
+            std::int64_t dif = static_cast<std::int64_t>(seq - pos);
+            if (dif == 0) {
+                if (tail.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) break;
+            } else if (dif < 0) {
+                lost.fetch_add(1, std::memory_order_relaxed); // full: the formatter is a lap behind
+                return;
+            } else {
+                pos = tail.load(std::memory_order_relaxed);
+            }
+        }
+        c->rec = r;
+        c->seq.store(pos + 1, std::memory_order_release);
+        wake_if_sleeping(sleeping);
+    }
+
+    void format_loop() {
+        std::string text;
+        for (;;) {
+            bool stop = stopping.load(std::memory_order_acquire);
+            std::uint64_t done = head;
+            while (ready()) {
+                Cell& c = cells[head & mask];
+                format(c.rec, text);
+                c.seq.store(head + cap, std::memory_order_release);
+                ++head;
+            }
+            if (head != done) {
+                sink.write(text.data(), static_cast<std::streamsize>(text.size()));
+                sink.flush();
+                text.clear();
+            }
+            written.store(head, std::memory_order_release);
+            wake_if_sleeping(flushing);
+            if (head != done) continue;
+            if (stop) return;
+            sleeping.store(1, std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            if (!ready() && !stopping.load(std::memory_order_relaxed)) futex_wait(sleeping);
+            sleeping.store(0, std::memory_order_relaxed);
+        }
+    }
+
+    static void format(const Record& r, std::string& text) {
+        text += "[Server] client ";
+        text += std::to_string(r.client);
+        if (r.kind == kExit) {
+            text += " exited, reclaimed ";
+            text += std::to_string(r.a);
+            text += " PIDs\n";
+            return;
+        }
+        text += " request ";
+        text += std::to_string(r.request);
+        if (r.kind == kAlloc) {
+            text += " asked for ";
+            text += std::to_string(r.a);
+            text += ", granted ";
+            text += std::to_string(r.b);
+            text += "\n";
+        } else if (r.kind == kRelease) {
+            text += " released ";
+            text += std::to_string(r.a);
+            text += "\n";
+        } else {
+            text += " done\n";
+        }
+    }
+
+    std::ostream& sink;
+    std::size_t cap = 1;
+    std::size_t mask = 0;
+    std::unique_ptr<Cell[]> cells;
+    alignas(64) std::atomic<std::uint64_t> tail{0};       // next position producers claim
+    std::atomic<std::uint64_t> lost{0};
+    std::atomic<std::uint64_t> sampled{0};
+    std::atomic<Level> level{kDebug};
+    std::atomic<std::uint32_t> sample_every{1};
+    alignas(64) std::uint64_t head = 0;                   // formatter only
+    std::atomic<std::uint64_t> written{0};                // head, once its text is out
+    std::atomic<bool> stopping{false};
+    alignas(64) Word sleeping{0};                         // the formatter waits for a record
+    Word flushing{0};                                     // a flush() waits for the formatter
+    std::thread formatter;
+};
+
+} // namespace pid_log
@@ -1,9 +1,17 @@
 // pid_manager.cpp
 #include <iostream>
 #include <vector>
+#include <cstdint>
+#include <string>
 #include <unistd.h>     // fork, getpid
 #include <sys/wait.h>   // waitpid
+#include <csignal>      // signal
 #include "pid_manager.hpp"
+#include "pid_protocol.hpp"
+#include "pid_server.hpp"
+#include "pid_log.hpp"
+#include "pid_shm_ring.hpp"
+#include "pid_client.hpp"
 
 // Pretty-print a list of PIDs
 static void print_list(const char* tag, const std::vector<int>& pids) {
@@ -15,22 +23,74 @@ static void print_list(const char* tag, const std::vector<int>& pids) {
     std::cout << "]\n";
 }
 
-int main() {
-    //Creating PIPE
-    int pipe_child_to_parent[2];
-    int pipe_parent_to_child[2];
-    if (pipe(pipe_child_to_parent) == -1 || pipe(pipe_parent_to_child) == -1) {
-        perror("Pipe Error");
+// A client: takes `count` PIDs through a PIDClient, which leases them from
+// the parent in prefetched blocks, then gives them back and says Done. With
+// `crash` set it dies holding them instead, and the parent has to notice.
+static int run_child(int request_fd, int reply_fd, int count, bool crash = false) {
+    PIDClient client(request_fd, reply_fd);
+    std::vector<int> child_allocated_pids;
+    for (int i = 0; i < count; ++i) {
+        int pid = client.allocate();
+        if (pid == -1) {
+            std::cerr << "[Child " << getpid() << "] No reply from parent\n";
+            return 1;
+        }
+        child_allocated_pids.push_back(pid);
+    }
+    std::cout << "Hello from child " << getpid() << ", received PIDs:";
+    print_list("", child_allocated_pids);
+    if (crash) {
+        std::cout << "[Child " << getpid() << "] Crashing without releasing them\n";
+        std::cout.flush();
+        _exit(1);
+    }
+
+    for (int pid : child_allocated_pids) client.release(pid);
+    if (client.finish() != 1) {
+        perror("write child release");
         return 1;
     }
+    return 0;
+}
 
+// The same client over a shared-memory ring slot: no syscalls unless one
+// side has to sleep.
+static int run_ring_child(pid_shm::Region& region, unsigned slot, int count) {
+    namespace proto = pid_protocol;
+    pid_shm::Client client(region, slot);
+    std::vector<char> out;
+    proto::Header h{};
+    std::vector<int> pids;
+    std::vector<int> got(static_cast<std::size_t>(count), -1); // by request id - 1
+    std::uint32_t next_id = 1;
+    for (int i = 0; i < count; ++i) proto::append(out, proto::kAlloc, 1, nullptr, next_id++);
+    client.send(out);
+    for (int i = 0; i < count; ++i) {
+        if (client.receive(h, pids, 5000) != 1 || h.op != proto::kPids || h.id == 0 ||
+            h.id > static_cast<std::uint32_t>(count)) {
+            std::cerr << "[Child " << getpid() << "] No reply on ring " << slot << "\n";
+            return 1;
+        }
+        if (!pids.empty()) got[h.id - 1] = pids[0];
+        out.clear();
+        proto::append(out, proto::kRelease, pids.size(), pids.data(), next_id++);
+        client.send(out);
+    }
+    std::cout << "Hello from ring child " << getpid() << ", received PIDs:";
+    print_list("", got);
+    out.clear();
+    proto::append(out, proto::kDone, 0, nullptr, next_id);
+    client.send(out);
+    return 0;
+}
 
+int main() {
     std::cout << "PID Manager Demo (OOP + bitmap). Process PID=" << getpid() << "\n";
     std::cout << "Global range: [" << MIN_PID << ", " << MAX_PID << "]\n\n";
 
     // ----- Parent process: create a manager and do some allocations -----
     PIDManager parentMgr;                 // uses MIN_PID..MAX_PID
-    if (parentMgr.allocate_map() != 1) {
+    if (parentMgr.enable_metadata() != 1 || parentMgr.allocate_map() != 1) {
         std::cerr << "Failed to initialize PID map in parent.\n";
         return 1;
     }
@@ -71,131 +131,147 @@ int main() {
         std::cout << "[Parent " << getpid() << "] Tiny-range re-allocation after release: " << again << "\n\n";
     }
 
-    // ----- fork() to demonstrate independent managers in parent vs child -----
-    pid_t child = fork();
-    if (child < 0) {
-        std::perror("fork");
+    // ----- fork() several clients and serve them all from one event loop.
+    // Even children get a pipe pair; odd ones connect to the Unix socket,
+    // as an unrelated process would. The last one crashes, and the server
+    // frees its PIDs when its pidfd reports the exit -----
+    const int CHILDREN = 4;
+    signal(SIGPIPE, SIG_IGN); // a client that dies shows up as a write error instead
+    PIDServer server(parentMgr);
+    server.watch_peers(true);
+    std::string sock_path = "/tmp/pid_manager_demo." + std::to_string(getpid()) + ".sock";
+    if (server.listen_unix(sock_path.c_str()) != 1) {
+        perror("listen_unix");
         return 1;
-    } else if (child == 0) {
-        // CHILD PROCESS: has its own address space; create its own manager
-        close(pipe_child_to_parent[0]); //CLOSING READEND OF CHILD to PARENT PIPE
-        close(pipe_parent_to_child[1]); // CLOSING WRITE END OF PARENT TO CHILD PIPE
-
-        std::vector<int> child_allocated_pids;
-
-        // Request-Receive-Release cycle for multiple PIDs
-        for (int i = 0; i < 3; ++i) {
-            // Send a request to parent, "1" meaning allocate PID
-            char request = 1;
-            if (write(pipe_child_to_parent[1], &request, 1) != 1){
-                perror("write child request");
-                break;
-            }
-
-            // Read allocated PID from parent (int)
-            int allocated_pid = -1;
-            ssize_t r = read(pipe_parent_to_child[0], &allocated_pid, sizeof(allocated_pid));
-            if (r <= 0) {
-                perror("child read pid");
-                break;
-            }
-            
-            if (allocated_pid != -1) {
-                child_allocated_pids.push_back(allocated_pid);
-                std::cout << "Hello from child, received PID: " << allocated_pid << "\n";
+    }
+    std::vector<pid_t> children;
+    std::vector<int> parent_fds; // our ends, which later children must not keep open
+    for (int i = 0; i < CHILDREN; ++i) {
+        if (i % 2 == 1) {
+            std::cout.flush(); // or the child inherits unflushed output
+            pid_t child = fork();
+            if (child < 0) {
+                std::perror("fork");
+                return 1;
+            } else if (child == 0) {
+                for (int fd : parent_fds) close(fd);
+                int fd = pid_protocol::connect_unix(sock_path.c_str());
+                int rc = fd == -1 ? 1 : run_child(fd, fd, 3 + i, i == CHILDREN - 1);
+                if (fd == -1) perror("connect");
+                else close(fd);
+                std::cout.flush(); // _exit skips stdio cleanup
+                _exit(rc);
             }
+            children.push_back(child);
+            continue;
         }
-
-        // Now release all the PIDs we allocated
-        for (int pid_to_release : child_allocated_pids) {
-            // Send release request, "2" meaning release PID
-            char release_request = 2;
-            if (write(pipe_child_to_parent[1], &release_request, 1) != 1) {
-                perror("write child release request");
-                break;
-            }
-            
-            // Send the PID to release
-            if (write(pipe_child_to_parent[1], &pid_to_release, sizeof(pid_to_release)) != sizeof(pid_to_release)) {
-                perror("write pid to release");
-                break;
-            }
+        int pipe_child_to_parent[2];
+        int pipe_parent_to_child[2];
+        if (pipe(pipe_child_to_parent) == -1 || pipe(pipe_parent_to_child) == -1) {
+            perror("Pipe Error");
+            return 1;
         }
-
-        // Send "Done" command, "3" meaning done
-        char done_request = 3;
-        if (write(pipe_child_to_parent[1], &done_request, 1) == 1) {
-            std::cout << "[Child " << getpid() << "] Sent Done command\n";
+        std::cout.flush(); // or the child inherits unflushed output
+        pid_t child = fork();
+        if (child < 0) {
+            std::perror("fork");
+            return 1;
+        } else if (child == 0) {
+            // CHILD PROCESS: has its own address space and only talks through its pipes
+            for (int fd : parent_fds) close(fd);
+            close(pipe_child_to_parent[0]); //CLOSING READEND OF CHILD to PARENT PIPE
+            close(pipe_parent_to_child[1]); // CLOSING WRITE END OF PARENT TO CHILD PIPE
+            int rc = run_child(pipe_child_to_parent[1], pipe_parent_to_child[0], 3 + i, i == CHILDREN - 1);
+            close(pipe_child_to_parent[1]);
+            close(pipe_parent_to_child[0]);
+            std::cout.flush(); // _exit skips stdio cleanup
+            _exit(rc);
         }
-        
-        close(pipe_child_to_parent[1]); //CLOSING WRITE END OF CHILD TO PARENT PIPE
-        close(pipe_parent_to_child[0]); //CLOSING READ END OF PARENT TO CHILD PIPE
-        _exit(0);
-    } else {
-        // PARENT continues with its manager while child runs
-
         close(pipe_child_to_parent[1]); // close write end of child's request pipe
         close(pipe_parent_to_child[0]); // close read end of parent's response pipe
+        parent_fds.push_back(pipe_child_to_parent[0]);
+        parent_fds.push_back(pipe_parent_to_child[1]);
+        children.push_back(child);
+        int id = server.add_client(pipe_child_to_parent[0], pipe_parent_to_child[1]);
+        if (id == -1 || server.watch_process(id, child) == -1) perror("add_client");
+    }
 
+    std::cout << "[Parent " << getpid() << "] Continuing allocations while children run...\n";
+    std::vector<int> moreParent;
+    for (int i = 0; i < 2; ++i) {
+        moreParent.push_back(parentMgr.allocate_pid());
+    }
+    std::cout << "[Parent " << getpid() << "] Additional PIDs: ";
+    print_list("", moreParent);
 
-
-        std::cout << "[Parent " << getpid() << "] Continuing allocations while child runs...\n";
-        std::vector<int> moreParent;
-        for (int i = 0; i < 2; ++i) {
-            moreParent.push_back(parentMgr.allocate_pid());
-        }
-        std::cout << "[Parent " << getpid() << "] Additional PIDs: ";
-        print_list("", moreParent);
-
-        char request;
-        while (read(pipe_child_to_parent[0], &request, 1) == 1){ //keeps looping if there is a request
-            if (request == 1) {
-                // Handle PID allocation request
-                int set_pid = parentMgr.allocate_pid();
-                std::cout << "[Parent " << getpid() << "] Allocated PID " << set_pid << " for child.\n";
-
-                if (write(pipe_parent_to_child[1], &set_pid, sizeof(set_pid)) != sizeof(set_pid)){ //writes the PID to the child
-                    perror("parent write pid");
-                    break;
-                }
-            }
-            else if (request == 2) {
-                // Handle PID release request
-                int pid_to_release;
-                if (read(pipe_child_to_parent[0], &pid_to_release, sizeof(pid_to_release)) == sizeof(pid_to_release)) {
-                    parentMgr.release_pid(pid_to_release);
-                    std::cout << "Parent received request to release PID: " << pid_to_release << "\n";
-                }
-            }
-            else if (request == 3) {
-                // Handle "Done" command
-                std::cout << "[Parent " << getpid() << "] Received Done command. Terminating gracefully.\n";
+    // Serve until every child has connected and exited. The log formats on
+    // its own thread, off the request path; it starts only now that the
+    // children are forked and is gone before the next fork()
+    {
+        pid_log::EventLog events(std::cout);
+        server.set_log(&events);
+        while (server.clients_seen() < static_cast<std::size_t>(CHILDREN) || server.client_count() > 0 ||
+               server.watching() > 0) {
+            if (server.poll_once(-1) == -1) {
+                perror("server");
                 break;
             }
         }
-        
-        int status = 0;
-        waitpid(child, &status, 0);
-        std::cout << "\n[Parent " << getpid() << "] Child " << child << " exited with status " << status << "\n";
+        server.set_log(nullptr);
+    } // writes out the rest before we share std::cout again
+    server.close_listener();
+    std::cout << "[Parent " << getpid() << "] Served " << server.frames_served() << " frames, reclaimed "
+              << server.reclaimed() << " PIDs from exited clients\n";
 
-        // Wrap up parent: release everything it took
-        for (int pid : parentPIDs) {
-            if (pid != -1) {
-                parentMgr.release_pid(pid);
-            }
-        }
-        for (int pid : moreParent) {
-            if (pid != -1) {
-                parentMgr.release_pid(pid);
-            }
+    // ----- Latency-critical clients over shared-memory rings, served by a
+    // poller instead of the event loop -----
+    const unsigned RING_CHILDREN = 2;
+    pid_shm::Region region(RING_CHILDREN);
+    std::uint32_t first_ring_owner = static_cast<std::uint32_t>(server.clients_seen()) + 1;
+    for (unsigned i = 0; i < RING_CHILDREN; ++i) {
+        std::cout.flush(); // or the child inherits unflushed output
+        pid_t child = fork();
+        if (child < 0) {
+            std::perror("fork");
+            return 1;
+        } else if (child == 0) {
+            int rc = run_ring_child(region, i, 2 + static_cast<int>(i));
+            std::cout.flush(); // _exit skips stdio cleanup
+            _exit(rc);
         }
-        std::cout << "[Parent " << getpid() << "] Done. Released all its PIDs.\n";
+        children.push_back(child);
+    }
+    PIDRingServer ringServer(parentMgr, region, first_ring_owner);
+    ringServer.run();
+    std::cout << "[Parent " << getpid() << "] Served " << ringServer.frames_served() << " ring frames\n";
 
-        close(pipe_child_to_parent[0]); //CLOSING read end of child's request pipe
-        close(pipe_parent_to_child[1]); //closing write end of parent's response pipe
+    for (std::size_t i = 0; i < children.size(); ++i) {
+        int status = 0;
+        waitpid(children[i], &status, 0);
+        std::cout << "\n[Parent " << getpid() << "] Child " << children[i] << " exited with status " << status << "\n";
+    }
 
+    // The ring server frees what a ring child held if it dies before Done;
+    // reclaim anything one left behind after a clean Done
+    for (std::uint32_t owner = first_ring_owner; owner < first_ring_owner + RING_CHILDREN; ++owner) {
+        size_t leaked = parentMgr.release_all(owner);
+        if (leaked > 0) {
+            std::cout << "[Parent " << getpid() << "] Reclaimed " << leaked << " PIDs client " << owner << " never released\n";
+        }
+    }
 
+    // Wrap up parent: release everything it took
+    for (int pid : parentPIDs) {
+        if (pid != -1) {
+            parentMgr.release_pid(pid);
+        }
+    }
+    for (int pid : moreParent) {
+        if (pid != -1) {
+            parentMgr.release_pid(pid);
+        }
     }
+    std::cout << "[Parent " << getpid() << "] Done. Released all its PIDs.\n";
 
     return 0;
 }
@@ -2,26 +2,224 @@
 #include <vector>
 #include <stdexcept>
 #include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <chrono>
+#include "simd_scan.hpp"
+#include "pid_cgroup.hpp"
 
 #define MIN_PID 100
 #define MAX_PID 1000
 
-class PIDManager {
+// Storage engines work on slots numbered 0..n-1 (slot = pid - min_pid).
+// The manager owns the PID <-> slot mapping and the allocation cursor; a
+// storage engine only answers bit queries on slots.
+//
+// A storage engine provides:
+//   void        reset(size_t n)                  size for n slots, all free
+//   void        resize(size_t n)                 keep contents, new slots free;
+//                   only shrinks when every slot >= n is already free
+//   bool        test(size_t slot) const
+//   void        set(size_t slot) / clear(size_t slot)
+//   size_t      find_clear(size_t from, size_t to) const
+//                   first free slot in [from, to), or `to` if there is none
+//   size_t      find_set(size_t from, size_t to) const
+//                   first allocated slot in [from, to), or `to` if there is none
+//   size_t      take_clear(size_t from, size_t to, size_t count, size_t* out)
+//                   marks up to `count` free slots in [from, to) allocated,
+//                   lowest first, writes them to out and returns how many
+
+// Resizes a storage vector, growing its capacity geometrically so that
+// raising pid_max one step at a time costs amortized O(1) per new slot.
+// New elements are set to `fill`.
+template <typename Vec>
+void resize_amortized(Vec& v, std::size_t n, const typename Vec::value_type& fill = typename Vec::value_type()) {
+    if (n > v.capacity()) v.reserve(std::max(n, 2 * v.capacity()));
+    v.resize(n, fill);
+}
+
+// One byte per PID slot; every search tests one slot at a time.
+class ByteMapStorage {
+public:
+    void reset(std::size_t n) {
+        bytes.assign(n, 0);
+    }
+
+    void resize(std::size_t n) {
+        resize_amortized(bytes, n);
+    }
+
+    bool test(std::size_t slot) const { return bytes[slot] != 0; }
+    void set(std::size_t slot) { bytes[slot] = 1; }
+    void clear(std::size_t slot) { bytes[slot] = 0; }
+
+    std::size_t find_clear(std::size_t from, std::size_t to) const {
+        for (std::size_t slot = from; slot < to; ++slot) {
+            if (bytes[slot] == 0) return slot;
+        }
+        return to;
+    }
+
+    std::size_t find_set(std::size_t from, std::size_t to) const {
+        for (std::size_t slot = from; slot < to; ++slot) {
+            if (bytes[slot] != 0) return slot;
+        }
+        return to;
+    }
+
+    std::size_t take_clear(std::size_t from, std::size_t to, std::size_t count, std::size_t* out) {
+        std::size_t taken = 0;
+        for (std::size_t slot = from; slot < to && taken < count; ++slot) {
+            if (bytes[slot] == 0) {
+                bytes[slot] = 1;
+                out[taken++] = slot;
+            }
+        }
+        return taken;
+    }
+
+private:
+    std::vector<unsigned char> bytes;
+};
+
+// Default storage engine: one bit per PID slot in 64-bit words. Searches
+// handle the partial first word directly and hand the rest to the SIMD
+// word-scan kernel, which skips 256-512 full (or empty) slots per step.
+class BitmapStorage {
+public:
+    void reset(std::size_t n) {
+        words.assign((n + 63) / 64, 0);
+    }
+
+    void resize(std::size_t n) {
+        resize_amortized(words, (n + 63) / 64);
+    }
+
+    bool test(std::size_t slot) const { return (words[slot >> 6] >> (slot & 63)) & 1u; }
+    void set(std::size_t slot) { words[slot >> 6] |= bit(slot); }
+    void clear(std::size_t slot) { words[slot >> 6] &= ~bit(slot); }
+
+    std::size_t find_clear(std::size_t from, std::size_t to) const {
+        return scan(from, to, ~std::uint64_t(0));
+    }
+
+    std::size_t find_set(std::size_t from, std::size_t to) const {
+        return scan(from, to, 0);
+    }
+
+    // Claims free bits a whole word at a time: one OR per word instead of
+    // one search and one store per slot.
+    std::size_t take_clear(std::size_t from, std::size_t to, std::size_t count, std::size_t* out) {
+        std::size_t taken = 0;
+        std::size_t slot = find_clear(from, to);
+        while (slot < to && taken < count) {
+            std::size_t w = slot >> 6;
+            std::uint64_t free = ~words[w] & (~std::uint64_t(0) << (slot & 63));
+            if (((w + 1) << 6) > to) free &= ~std::uint64_t(0) >> (((w + 1) << 6) - to);
+            std::uint64_t grab = 0;
+            for (; free != 0 && taken < count; free &= free - 1) {
+                std::uint64_t low = free & (~free + 1);
+                grab |= low;
+                out[taken++] = (w << 6) + static_cast<std::size_t>(__builtin_ctzll(low));
+            }
+            words[w] |= grab;
+            slot = find_clear((w + 1) << 6, to);
+        }
+        return taken;
+    }
+
+private:
+    static std::uint64_t bit(std::size_t slot) { return std::uint64_t(1) << (slot & 63); }
+
+    // First slot in [from, to) whose bit differs from the bits of `skip`.
+    std::size_t scan(std::size_t from, std::size_t to, std::uint64_t skip) const {
+        if (from >= to) return to;
+        std::size_t w = from >> 6;
+        std::size_t end = ((to - 1) >> 6) + 1;
+        std::uint64_t hits = (words[w] ^ skip) & (~std::uint64_t(0) << (from & 63));
+        if (hits == 0) {
+            w = simd_scan::find_word(words.data(), w + 1, end, skip);
+            if (w == end) return to;
+            hits = words[w] ^ skip;
+        }
+        std::size_t slot = (w << 6) + static_cast<std::size_t>(__builtin_ctzll(hits));
+        return slot < to ? slot : to;
+    }
+
+    std::vector<std::uint64_t> words;
+};
+
+// A closed interval [first, last] of PIDs.
+struct PIDRange {
+    int first;
+    int last;
+};
+
+// Per-PID metadata kept by the optional side table (see enable_metadata).
+struct PIDInfo {
+    std::uint32_t owner;        // client id; 0 = unowned
+    int parent;                 // parent PID, -1 if none
+    std::uint64_t created_ns;   // steady_clock timestamp at allocation
+};
+
+template <typename Storage>
+class BasicPIDManager {
 public:
-    explicit PIDManager(int minPid = MIN_PID, int maxPid = MAX_PID)
-        : min_pid(minPid), max_pid(maxPid),
-          bitmap(static_cast<size_t>(maxPid + 1), 0),
-          next(minPid), initialized_(false) {
-        if (min_pid < 0 || max_pid < min_pid) {
+    // Largest owner id. Owner ids index a flat per-owner table, so they must
+    // be small, dense ids such as client numbers; calls given a larger one
+    // (the metadata poison value included) fail with -1.
+    static constexpr std::uint32_t kMaxOwner = (1u << 20) - 1;
+
+    explicit BasicPIDManager(int minPid = MIN_PID, int maxPid = MAX_PID)
+        : BasicPIDManager(std::vector<PIDRange>{PIDRange{minPid, maxPid}}) {}
+
+    // A PID space made of disjoint intervals. The gaps between them are never
+    // handed out and cost nothing: slots are numbered densely across the
+    // intervals, so storage and scans only cover usable PIDs, and the
+    // allocation cursor steps straight from one interval into the next.
+    explicit BasicPIDManager(std::vector<PIDRange> ranges)
+        : next(0), initialized_(false) {
+        std::sort(ranges.begin(), ranges.end(),
+                  [](const PIDRange& a, const PIDRange& b) { return a.first < b.first; });
+        for (const PIDRange& r : ranges) {
+            if (r.first < 0 || r.last < r.first) {
+                throw std::invalid_argument("Invalid PID range");
+            }
+            if (!segments.empty() && r.first <= segments.back().last) {
+                throw std::invalid_argument("Overlapping PID ranges");
+            }
+            if (!segments.empty() && r.first == segments.back().last + 1) {
+                segments.back().last = r.last; // adjacent: merge
+                continue;
+            }
+            std::size_t base = segments.empty() ? 0 : segments.back().base + span(segments.back());
+            segments.push_back(Segment{r.first, r.last, base});
+        }
+        if (segments.empty()) {
             throw std::invalid_argument("Invalid PID range");
         }
+        min_pid = segments.front().first;
+        max_pid = pid_limit = segments.back().last;
     }
 
     // Creates and initializes the PID map. Returns -1 on failure, 1 on success.
     int allocate_map(void) {
         try {
-            std::fill(bitmap.begin(), bitmap.end(), 0);
-            next = min_pid;
+            set_extent(pid_limit); // a pending shrink has nothing left to wait for
+            uncharge_all();
+            if (limits) charged.assign(slot_count(), kUncharged);
+            storage.reset(slot_count());
+            exited.reset(slot_count());
+            exited_count = 0;
+            if (meta_enabled) meta.reset(slot_count());
+            reserved.reset(slot_count());
+            reserved_count = 0;
+            spare.clear();
+            live = 0;
+            next = 0;
+            for (Pool& p : pools) p.cursor = p.first;
+            map_pools(0);
             initialized_ = true;
             return 1;
         } catch (...) {
@@ -31,50 +229,895 @@ public:
     }
 
     // Allocates and returns a PID; returns -1 if not initialized or if all are in use.
+    // Draws only from PIDs outside every pool; pools are reached through
+    // allocate_pid(pool).
     int allocate_pid(void) {
         if (!initialized_) return -1;
-        if (min_pid > max_pid) return -1;
+        std::size_t slot = claim_open();
+        if (slot == npos) return -1;
+        if (meta_enabled) record(slot, 0, -1);
+        return pid_of(slot);
+    }
 
-        int start = next;
-        for (int pid = start; pid <= max_pid; ++pid) {
-            if (bitmap[pid] == 0) {
-                bitmap[pid] = 1;
-                next = (pid + 1 > max_pid) ? min_pid : pid + 1;
-                return pid;
-            }
+    // Like allocate_pid(), and records owner, parent and creation time in the
+    // metadata side table (when enabled).
+    int allocate_pid_for(std::uint32_t owner, int parent = -1) {
+        if (!initialized_ || owner > kMaxOwner) return -1;
+        std::size_t slot = claim_open();
+        if (slot == npos) return -1;
+        if (meta_enabled) record(slot, owner, parent);
+        return pid_of(slot);
+    }
+
+    // Allocates from a pool; when the pool is exhausted its spillover pools
+    // are tried in order. Returns -1 if not initialized, the pool id is
+    // invalid, or the pool and its spillover targets are all full.
+    int allocate_pid(int pool) {
+        if (!initialized_) return -1;
+        if (pool < 0 || static_cast<std::size_t>(pool) >= pools.size()) return -1;
+        Pool& p = pools[static_cast<std::size_t>(pool)];
+        std::size_t slot = claim_from(p);
+        for (std::size_t i = 0; slot == npos && i < p.spill.size(); ++i) {
+            slot = claim_from(pools[static_cast<std::size_t>(p.spill[i])]);
         }
-        for (int pid = min_pid; pid < start; ++pid) {
-            if (bitmap[pid] == 0) {
-                bitmap[pid] = 1;
-                next = (pid + 1 > max_pid) ? min_pid : pid + 1;
-                return pid;
-            }
+        if (slot == npos) return -1;
+        if (meta_enabled) record(slot, 0, -1);
+        return pid_of(slot);
+    }
+
+    // Defines a named pool over the PIDs in [first, last]. Pools share the
+    // manager's storage; each keeps its own cursor over its slice of it, and
+    // the default allocator no longer hands out PIDs in it. A slot -> pool
+    // table, sized with the storage, finds the owning pool on release.
+    // Returns the pool id, or -1 if the name is taken or the range is empty,
+    // outside the PID space, or overlaps another pool.
+    int add_pool(const std::string& name, int first, int last) {
+        if (first > last || pool_id(name) != -1) return -1;
+        if (first < min_pid || last > pid_limit) return -1;
+        Pool p;
+        p.name = name;
+        p.first = slot_at_or_after(first);
+        p.end = (last == max_pid) ? slot_count() : slot_at_or_after(last + 1);
+        p.cursor = p.first;
+        if (p.first >= p.end) return -1; // entirely inside a hole
+        for (const Pool& other : pools) {
+            if (p.first < other.end && other.first < p.end) return -1;
+        }
+        try {
+            pools.push_back(p);
+            map_pools(0);
+            fence_pools();
+        } catch (...) {
+            pools.pop_back();
+            return -1;
         }
-        return -1; // exhausted
+        return static_cast<int>(pools.size() - 1);
+    }
+
+    // Sets the pools tried, in order, when `pool` is exhausted. Spillover is
+    // one level deep: a target's own spillover list is not followed.
+    // Returns 1 on success, -1 on an invalid pool id.
+    int set_spillover(int pool, const std::vector<int>& targets) {
+        if (pool < 0 || static_cast<std::size_t>(pool) >= pools.size()) return -1;
+        for (int t : targets) {
+            if (t < 0 || static_cast<std::size_t>(t) >= pools.size() || t == pool) return -1;
+        }
+        pools[static_cast<std::size_t>(pool)].spill = targets;
+        return 1;
+    }
+
+    // Returns the id of the named pool, or -1.
+    int pool_id(const std::string& name) const {
+        for (std::size_t i = 0; i < pools.size(); ++i) {
+            if (pools[i].name == name) return static_cast<int>(i);
+        }
+        return -1;
     }
 
     // Releases a PID; safe no-op if not initialized, invalid PID, or already free.
+    // A reserved PID belongs to its token and is left alone (see abort).
     void release_pid(int pid) {
         if (!initialized_) return;
-        if (pid < min_pid || pid > max_pid) return;
-        bitmap[pid] = 0;
-        if (pid < next) next = pid; // bias to reuse earlier frees
+        if (!contains(pid, max_pid)) return;
+        std::size_t slot = slot_of(pid);
+        if (is_reserved(slot)) return;
+        free_slot(slot);
+    }
+
+    // All-or-nothing allocation of n PIDs, e.g. for a thread group. The free
+    // count is checked first, so a request that can't be met fails without
+    // touching the map; otherwise the PIDs are claimed from the cursor in
+    // word-sized batches (storage take_clear) and appended to `pids`.
+    // Returns 1 on success, -1 (nothing allocated) if not initialized, n < 0,
+    // or fewer than n PIDs are free.
+    int allocate_atomic(int n, std::vector<int>& pids, std::uint32_t owner = 0) {
+        if (!initialized_ || n < 0 || owner > kMaxOwner) return -1;
+        std::size_t want = static_cast<std::size_t>(n);
+        if (want > free_count()) return -1;
+        std::vector<std::size_t> slots(want);
+        std::size_t cap = capacity();
+        std::size_t got = 0;
+        each_open(next < cap ? next : 0, [&](std::size_t lo, std::size_t hi) {
+            got += storage.take_clear(lo, hi, want - got, slots.data() + got);
+            return got == want;
+        });
+        if (got < want) { // the free PIDs were inside pools
+            for (std::size_t i = 0; i < got; ++i) storage.clear(slots[i]);
+            return -1;
+        }
+        live += got;
+        if (got > 0) {
+            // Last slot taken in cursor order: the wrapped part if there is one.
+            std::size_t last = slots[got - 1];
+            next = (last + 1 == cap) ? 0 : last + 1;
+        }
+        pids.reserve(pids.size() + got);
+        for (std::size_t i = 0; i < got; ++i) {
+            if (meta_enabled) record(slots[i], owner, -1);
+            pids.push_back(pid_of(slots[i]));
+        }
+        return 1;
+    }
+
+    // PIDs that can still be handed out. While a shrink is pending, PIDs
+    // above the new limit are still counted as live, so this errs low.
+    std::size_t free_count() const {
+        std::size_t cap = capacity();
+        return live >= cap ? 0 : cap - live;
+    }
+
+    // Two-phase allocation. reserve_pid() picks a PID and holds it; the
+    // returned token (the PID itself) is then either committed, making the
+    // PID allocated, or aborted. Until then the PID can't be handed out
+    // again but is_allocated() reports it as free. Returns -1 if not
+    // initialized or exhausted.
+    //
+    // Aborted PIDs go to a small local stack that the next reserve_pid()
+    // takes from first; unlike release_pid(), abort() doesn't move the
+    // allocation cursor. Reservations are marked in a second map of the
+    // same engine (like zombies), so is_allocated and release_pid pay one
+    // bit test for them however many are outstanding.
+    int reserve_pid(void) {
+        if (!initialized_) return -1;
+        std::size_t slot = npos;
+        while (!spare.empty() && slot == npos) {
+            std::size_t s = spare.back();
+            spare.pop_back();
+            if (s < capacity() && !storage.test(s)) {
+                storage.set(s);
+                ++live;
+                slot = s;
+            }
+        }
+        if (slot == npos) slot = claim_open();
+        if (slot == npos) return -1;
+        reserved.set(slot);
+        ++reserved_count;
+        return pid_of(slot);
+    }
+
+    // Makes a reserved PID allocated, recording owner/parent if metadata is on.
+    // Returns 1 on success, -1 if `token` isn't an outstanding reservation or
+    // the owner id is out of range (the reservation then stays outstanding).
+    int commit(int token, std::uint32_t owner = 0, int parent = -1) {
+        if (owner > kMaxOwner) return -1;
+        std::size_t slot;
+        if (!take_reservation(token, slot)) return -1;
+        if (meta_enabled) record(slot, owner, parent);
+        return 1;
+    }
+
+    // Gives a reserved PID back without disturbing the allocation cursor.
+    // Returns 1 on success, -1 if `token` isn't an outstanding reservation.
+    int abort(int token) {
+        std::size_t slot;
+        if (!take_reservation(token, slot)) return -1;
+        storage.clear(slot);
+        --live;
+        spare.push_back(slot);
+        if (slot >= capacity()) finish_shrink();
+        return 1;
+    }
+
+    std::size_t reservations() const { return reserved_count; }
+
+    // Releases every PID recorded for `owner` (see allocate_pid_for) in
+    // O(k) for k owned PIDs: each owner's slots are threaded on an intrusive
+    // list through next/prev index arrays in the metadata table, so nothing
+    // is scanned. Returns the number of PIDs released; 0 if metadata is off.
+    std::size_t release_all(std::uint32_t owner) {
+        if (!initialized_ || !meta_enabled || owner == 0) return 0;
+        std::size_t freed = 0;
+        while (meta.owned_count(owner) != 0) {
+            free_slot(meta.owners[owner].head);
+            ++freed;
+        }
+        return freed;
+    }
+
+    // Number of live PIDs recorded for `owner`, in O(1).
+    std::size_t owned_count(std::uint32_t owner) const {
+        return meta_enabled && owner != 0 ? meta.owned_count(owner) : 0;
+    }
+
+    // Changes the top of the PID range (pid_max) without rebuilding the map;
+    // with several intervals it moves the end of the last one.
+    // Growing takes effect immediately and keeps every allocation; the storage
+    // grows geometrically, so it is amortized O(1) per new slot. Shrinking
+    // below a live PID is deferred: PIDs above new_max are no longer handed
+    // out, and the range is cut when the last of them is released.
+    // Returns 1 if applied, 0 if deferred, -1 if new_max is invalid.
+    int resize(int new_max) {
+        if (new_max < segments.back().first) return -1;
+        if (!initialized_) {
+            try {
+                if (limits) charged.resize(slots_through(new_max), kUncharged); // nothing is charged yet
+            } catch (...) {
+                return -1;
+            }
+            set_extent(new_max);
+            pid_limit = new_max;
+            return 1;
+        }
+        if (new_max > max_pid) {
+            try {
+                storage.resize(slots_through(new_max));
+                exited.resize(slots_through(new_max));
+                reserved.resize(slots_through(new_max));
+                if (limits) resize_amortized(charged, slots_through(new_max), kUncharged);
+                if (meta_enabled) meta.resize(slots_through(new_max));
+                std::size_t old = slot_count();
+                set_extent(new_max);
+                map_pools(old);
+            } catch (...) {
+                return -1;
+            }
+        }
+        pid_limit = new_max;
+        if (next >= capacity()) next = 0;
+        return finish_shrink() ? 1 : 0;
+    }
+
+    // True while a shrink is waiting for PIDs above max() to be released.
+    bool resize_pending() const { return max_pid != pid_limit; }
+
+    // Turns on the per-PID metadata side table: owner, parent and creation
+    // time, stored as parallel arrays indexed by slot (pid - min_pid for a
+    // single range) and sized with the bitmap. Lookups are one indexed load
+    // per field, no hashing. Released slots are poisoned. Live PIDs at the
+    // time of the call get owner 0 and no parent.
+    // Returns 1 on success, -1 if the table can't be allocated.
+    int enable_metadata(void) {
+        if (meta_enabled) return 1;
+        try {
+            if (initialized_) {
+                meta.reset(slot_count());
+                for (std::size_t s = storage.find_set(0, slot_count()); s < slot_count();
+                     s = storage.find_set(s + 1, slot_count())) {
+                    meta.record(s, 0, -1, Metadata::kNil);
+                }
+            }
+        } catch (...) {
+            return -1;
+        }
+        meta_enabled = true;
+        return 1;
+    }
+    bool has_metadata() const { return meta_enabled; }
+
+    // Fills `out` for a live PID. Returns false if metadata is off or the
+    // PID isn't allocated.
+    bool get_info(int pid, PIDInfo& out) const {
+        if (!meta_enabled || !is_allocated(pid)) return false;
+        std::size_t slot = slot_of(pid);
+        out.owner = meta.owner[slot];
+        out.parent = meta.parent[slot];
+        out.created_ns = meta.created_ns[slot];
+        return true;
+    }
+
+    // Process tree (requires metadata): every PID allocated with a live
+    // parent (allocate_pid_for / commit) is linked under it. When a PID is
+    // released its children are re-parented to its own parent, or become
+    // roots if it had none.
+
+    // The parent of a live PID, or -1.
+    int parent_of(int pid) const {
+        if (!meta_enabled || !is_allocated(pid)) return -1;
+        return meta.parent[slot_of(pid)];
+    }
+
+    // The children of a live PID, most recently created first.
+    std::vector<int> children(int pid) const {
+        std::vector<int> out;
+        if (!meta_enabled || !is_allocated(pid)) return out;
+        for (std::uint32_t c = meta.first_child[slot_of(pid)]; c != Metadata::kNil; c = meta.next_sibling[c]) {
+            out.push_back(pid_of(c));
+        }
+        return out;
+    }
+
+    // Moves all children of `pid` under `new_parent` (-1 makes them roots),
+    // in O(children) plus a walk up from new_parent to rule out cycles.
+    // Returns the number moved, or -1 if either PID isn't live or
+    // new_parent lies inside pid's subtree.
+    int reparent_children(int pid, int new_parent) {
+        if (!meta_enabled || !is_allocated(pid)) return -1;
+        std::uint32_t to = Metadata::kNil;
+        if (new_parent != -1) {
+            if (!is_allocated(new_parent)) return -1;
+            to = static_cast<std::uint32_t>(slot_of(new_parent));
+            for (std::uint32_t a = to; a != Metadata::kNil; a = meta.parent_slot[a]) {
+                if (a == slot_of(pid)) return -1;
+            }
+        }
+        return static_cast<int>(meta.move_children(slot_of(pid), to, new_parent));
+    }
+
+    // Releases `pid` and every descendant in O(subtree size): it walks down
+    // to a leaf, frees it, and steps back to the parent, using the links
+    // themselves as the stack. Returns the number of PIDs released.
+    std::size_t release_subtree(int pid) {
+        if (!meta_enabled || !is_allocated(pid)) return 0;
+        std::size_t root = slot_of(pid);
+        std::size_t cur = root;
+        std::size_t freed = 0;
+        for (;;) {
+            if (meta.first_child[cur] != Metadata::kNil) {
+                cur = meta.first_child[cur];
+                continue;
+            }
+            std::uint32_t up = meta.parent_slot[cur];
+            free_slot(cur); // a leaf: nothing to re-parent
+            ++freed;
+            if (cur == root) break;
+            cur = up;
+        }
+        return freed;
+    }
+
+    // Limit groups (pid_cgroup.hpp). Attaching is refused while PIDs from
+    // an earlier attachment are still charged; nullptr detaches.
+    // Returns 1, or -1.
+    int attach_limits(PIDLimitGroups* groups) {
+        for (std::uint32_t g : charged) {
+            if (g != kUncharged) return -1;
+        }
+        try {
+            charged.assign(groups ? slot_count() : 0, kUncharged);
+        } catch (...) {
+            return -1;
+        }
+        limits = groups;
+        return 1;
+    }
+
+    // Allocates a PID charged to limit group `group`, which is charged
+    // before the map is scanned, so a group at its limit costs no scan.
+    // Releasing the PID (by any route) uncharges it. Returns -1 if no limits
+    // are attached, the group or an ancestor is at its limit, or the map is full.
+    int allocate_pid_in(int group, std::uint32_t owner = 0, int parent = -1) {
+        if (!initialized_ || !limits || owner > kMaxOwner) return -1;
+        if (!limits->try_charge(group)) return -1;
+        std::size_t slot = claim_open();
+        if (slot == npos) {
+            limits->uncharge(group);
+            return -1;
+        }
+        charged[slot] = static_cast<std::uint32_t>(group);
+        if (meta_enabled) record(slot, owner, parent);
+        return pid_of(slot);
+    }
+
+    // The limit group a live PID is charged to, or -1.
+    int group_of(int pid) const {
+        if (!limits || !is_allocated(pid)) return -1;
+        std::uint32_t g = charged[slot_of(pid)];
+        return g == kUncharged ? -1 : static_cast<int>(g);
+    }
+
+    // Zombies: a PID that has exited but not been reaped. Its slot stays set
+    // in the allocation map, so every scan skips it exactly like a live PID
+    // with no extra work; a second map of the same engine marks which set
+    // slots are zombies, for is_zombie and word-speed enumeration. Zombies
+    // still count as allocated; release_pid and release_all reap them too.
+
+    // Moves a live PID to the zombie state. With metadata, its children are
+    // re-parented at exit (as on Linux) while it stays in its parent's child
+    // list until reaped. Returns 1, or -1 if the PID isn't live.
+    int exit_pid(int pid) {
+        if (!is_allocated(pid) || is_zombie(pid)) return -1;
+        std::size_t slot = slot_of(pid);
+        exited.set(slot);
+        ++exited_count;
+        if (meta_enabled) meta.move_children(slot, meta.parent_slot[slot], meta.parent[slot]);
+        return 1;
+    }
+
+    // Frees a zombie. Returns 1, or -1 if the PID isn't a zombie.
+    int reap(int pid) {
+        if (!is_zombie(pid)) return -1;
+        free_slot(slot_of(pid));
+        return 1;
+    }
+
+    // Reaps one zombie child of `parent` in O(children), like wait().
+    // Returns its PID, or -1 if there is none (or metadata is off).
+    int reap_child(int parent) {
+        if (!meta_enabled || !is_allocated(parent)) return -1;
+        for (std::uint32_t c = meta.first_child[slot_of(parent)]; c != Metadata::kNil; c = meta.next_sibling[c]) {
+            if (exited.test(c)) {
+                int pid = pid_of(c);
+                free_slot(c);
+                return pid;
+            }
+        }
+        return -1;
+    }
+
+    bool is_zombie(int pid) const {
+        if (!initialized_ || exited_count == 0 || !contains(pid, max_pid)) return false;
+        return exited.test(slot_of(pid));
+    }
+
+    // All zombies in ascending PID order.
+    std::vector<int> zombies() const {
+        std::vector<int> out;
+        if (!initialized_ || exited_count == 0) return out;
+        out.reserve(exited_count);
+        std::size_t n = slot_count();
+        for (std::size_t s = exited.find_set(0, n); s < n; s = exited.find_set(s + 1, n)) out.push_back(pid_of(s));
+        return out;
+    }
+
+    std::size_t zombie_count() const { return exited_count; }
+
+    // Successor queries: the first free / allocated PID >= pid, or -1 if none.
+    // A reserved, uncommitted PID is neither, as for is_allocated().
+    int next_free(int pid) const { return successor(pid, false); }
+    int next_allocated(int pid) const { return successor(pid, true); }
+
+    // Number of PIDs that can be handed out (the range minus any holes).
+    std::size_t capacity() const { return slots_through(pid_limit); }
+
+    // The intervals making up the allocatable PID space.
+    std::vector<PIDRange> ranges() const {
+        std::vector<PIDRange> out;
+        for (const Segment& seg : segments) out.push_back(PIDRange{seg.first, seg.last});
+        out.back().last = pid_limit;
+        return out;
     }
 
     // Helpers for tests
     bool initialized() const { return initialized_; }
     int min() const { return min_pid; }
-    int max() const { return max_pid; }
-    bool in_range(int pid) const { return pid >= min_pid && pid <= max_pid; }
+    int max() const { return pid_limit; }
+    bool in_range(int pid) const { return contains(pid, pid_limit); }
     bool is_allocated(int pid) const {
-        if (pid < min_pid || pid > max_pid) return false;
-        return bitmap[pid] != 0;
+        if (!initialized_) return false;
+        if (!contains(pid, max_pid)) return false;
+        std::size_t slot = slot_of(pid);
+        return storage.test(slot) && !is_reserved(slot);
     }
+    const Storage& storage_engine() const { return storage; }
 
 private:
+    struct Segment {
+        int first;
+        int last;         // for the last segment this tracks max_pid
+        std::size_t base; // slot of `first`
+    };
+
+    struct Gap {
+        std::size_t first;       // slot range [first, end) outside every pool
+        std::size_t end;
+    };
+
+    struct Pool {
+        std::string name;
+        std::size_t first;       // slot range [first, end)
+        std::size_t end;
+        std::size_t cursor;
+        std::vector<int> spill;  // pool ids tried when this one is full
+    };
+
+    static constexpr std::size_t npos = static_cast<std::size_t>(-1);
+
+    // Structure-of-arrays metadata, one entry per slot. Slots with an owner
+    // are also linked into that owner's list through owned_next/owned_prev.
+    // Owner ids index a flat table, hence kMaxOwner. The process tree is threaded through the same kind
+    // of index arrays: parent_slot, first_child and a doubly linked sibling
+    // list, so tree walks never hash or chase heap pointers.
+    struct Metadata {
+        static constexpr std::uint32_t kPoisonOwner = 0xDEADDEADu;
+        static constexpr int kPoisonParent = -2;
+        static constexpr std::uint32_t kNil = 0xFFFFFFFFu;
+        static_assert(kPoisonOwner > kMaxOwner, "the poison value is never a valid owner");
+
+        struct OwnerList {
+            std::uint32_t head = kNil;
+            std::size_t count = 0;
+        };
+
+        std::vector<std::uint32_t> owner;
+        std::vector<int> parent;
+        std::vector<std::uint64_t> created_ns;
+        std::vector<std::uint32_t> owned_next;
+        std::vector<std::uint32_t> owned_prev;
+        std::vector<OwnerList> owners;          // indexed by owner id
+        std::vector<std::uint32_t> parent_slot;
+        std::vector<std::uint32_t> first_child;
+        std::vector<std::uint32_t> next_sibling;
+        std::vector<std::uint32_t> prev_sibling;
+
+        void reset(std::size_t n) {
+            owner.assign(n, kPoisonOwner);
+            parent.assign(n, kPoisonParent);
+            created_ns.assign(n, 0);
+            owned_next.assign(n, kNil);
+            owned_prev.assign(n, kNil);
+            owners.clear();
+            parent_slot.assign(n, kNil);
+            first_child.assign(n, kNil);
+            next_sibling.assign(n, kNil);
+            prev_sibling.assign(n, kNil);
+        }
+        void resize(std::size_t n) {
+            std::size_t old = owner.size();
+            resize_amortized(owner, n);
+            resize_amortized(parent, n);
+            resize_amortized(created_ns, n);
+            resize_amortized(owned_next, n);
+            resize_amortized(owned_prev, n);
+            resize_amortized(parent_slot, n);
+            resize_amortized(first_child, n);
+            resize_amortized(next_sibling, n);
+            resize_amortized(prev_sibling, n);
+            for (std::size_t s = old; s < n; ++s) {
+                owner[s] = kPoisonOwner;
+                parent[s] = kPoisonParent;
+                created_ns[s] = 0;
+                owned_next[s] = owned_prev[s] = kNil;
+                parent_slot[s] = first_child[s] = next_sibling[s] = prev_sibling[s] = kNil;
+            }
+        }
+        void record(std::size_t slot, std::uint32_t who, int parent_pid, std::uint32_t parent_at) {
+            owner[slot] = who;
+            parent[slot] = parent_pid;
+            if (parent_at != kNil) adopt(slot, parent_at);
+            created_ns[slot] = static_cast<std::uint64_t>(
+                std::chrono::duration_cast<std::chrono::nanoseconds>(
+                    std::chrono::steady_clock::now().time_since_epoch()).count());
+            if (who != 0) link(slot, who);
+        }
+        void poison(std::size_t slot) {
+            if (owner[slot] != 0 && owner[slot] != kPoisonOwner) unlink(slot, owner[slot]);
+            owner[slot] = kPoisonOwner;
+            parent[slot] = kPoisonParent;
+            created_ns[slot] = 0;
+        }
+        std::size_t owned_count(std::uint32_t who) const {
+            return who < owners.size() ? owners[who].count : 0;
+        }
+
+        // Links `child` at the head of `parent_at`'s child list.
+        void adopt(std::size_t child, std::uint32_t parent_at) {
+            std::uint32_t c = static_cast<std::uint32_t>(child);
+            parent_slot[child] = parent_at;
+            prev_sibling[child] = kNil;
+            next_sibling[child] = first_child[parent_at];
+            if (first_child[parent_at] != kNil) prev_sibling[first_child[parent_at]] = c;
+            first_child[parent_at] = c;
+        }
+
+        // Unlinks `child` from its parent's child list, if it has a parent.
+        void detach(std::size_t child) {
+            std::uint32_t p = parent_slot[child];
+            if (p == kNil) return;
+            std::uint32_t prev = prev_sibling[child], nxt = next_sibling[child];
+            if (prev != kNil) next_sibling[prev] = nxt;
+            else first_child[p] = nxt;
+            if (nxt != kNil) prev_sibling[nxt] = prev;
+            parent_slot[child] = next_sibling[child] = prev_sibling[child] = kNil;
+        }
+
+        // Moves every child of `slot` under `to` (kNil: they become roots),
+        // in O(children). Returns how many moved.
+        std::size_t move_children(std::size_t slot, std::uint32_t to, int to_pid) {
+            std::size_t moved = 0;
+            std::uint32_t c = first_child[slot];
+            first_child[slot] = kNil;
+            while (c != kNil) {
+                std::uint32_t following = next_sibling[c];
+                parent[c] = to_pid;
+                parent_slot[c] = kNil;
+                next_sibling[c] = prev_sibling[c] = kNil;
+                if (to != kNil) adopt(c, to);
+                ++moved;
+                c = following;
+            }
+            return moved;
+        }
+
+    private:
+        void link(std::size_t slot, std::uint32_t who) {
+            if (who >= owners.size()) owners.resize(static_cast<std::size_t>(who) + 1);
+            OwnerList& list = owners[who];
+            std::uint32_t s = static_cast<std::uint32_t>(slot);
+            owned_prev[slot] = kNil;
+            owned_next[slot] = list.head;
+            if (list.head != kNil) owned_prev[list.head] = s;
+            list.head = s;
+            ++list.count;
+        }
+        void unlink(std::size_t slot, std::uint32_t who) {
+            OwnerList& list = owners[who];
+            std::uint32_t prev = owned_prev[slot], nxt = owned_next[slot];
+            if (prev != kNil) owned_next[prev] = nxt;
+            else list.head = nxt;
+            if (nxt != kNil) owned_prev[nxt] = prev;
+            owned_next[slot] = owned_prev[slot] = kNil;
+            --list.count;
+        }
+    };
+
+    // Takes the first free slot in [first, end) at or after `cursor`,
+    // wrapping around once, and advances the cursor past it.
+    std::size_t claim(std::size_t first, std::size_t end, std::size_t& cursor) {
+        if (first >= end) return npos;
+        std::size_t start = (cursor >= first && cursor < end) ? cursor : first;
+        std::size_t slot = storage.find_clear(start, end);
+        if (slot == end) {
+            slot = storage.find_clear(first, start);
+            if (slot == start) return npos; // exhausted
+        }
+        storage.set(slot);
+        ++live;
+        cursor = (slot + 1 == end) ? first : slot + 1;
+        return slot;
+    }
+
+    std::size_t claim_from(Pool& p) {
+        return claim(p.first, std::min(p.end, capacity()), p.cursor);
+    }
+
+    // claim() for the default allocator: the first free slot outside every
+    // pool at or after the cursor, wrapping around once.
+    std::size_t claim_open() {
+        std::size_t cap = capacity();
+        if (open.empty()) return claim(0, cap, next);
+        std::size_t slot = npos;
+        each_open(next < cap ? next : 0, [&](std::size_t lo, std::size_t hi) {
+            std::size_t s = storage.find_clear(lo, hi);
+            if (s == hi) return false;
+            slot = s;
+            return true;
+        });
+        if (slot == npos) return npos;
+        storage.set(slot);
+        ++live;
+        next = (slot + 1 == cap) ? 0 : slot + 1;
+        return slot;
+    }
+
+    // Calls fn(lo, hi) on each stretch of slots below capacity() that lies
+    // outside every pool, in cursor order: from `start` to the end, then
+    // from 0 up to `start`. Stops early once fn returns true.
+    template <typename Fn>
+    void each_open(std::size_t start, Fn fn) const {
+        std::size_t cap = capacity();
+        if (open.empty()) {
+            if (!fn(start, cap)) fn(0, start);
+            return;
+        }
+        // The gap the cursor is in, or the next one after it.
+        std::size_t i = static_cast<std::size_t>(
+            std::upper_bound(open.begin(), open.end(), start,
+                             [](std::size_t s, const Gap& g) { return s < g.end; }) - open.begin());
+        if (i == open.size()) {
+            i = 0;
+            start = 0;
+        }
+        for (std::size_t k = 0; k <= open.size(); ++k) {
+            const Gap& g = open[(i + k) % open.size()];
+            std::size_t lo = k == 0 ? std::max(g.first, start) : g.first;
+            std::size_t hi = std::min(g.end, cap);
+            if (k == open.size()) hi = std::min(hi, start); // back round to the start
+            if (lo < hi && fn(lo, hi)) return;
+        }
+    }
+
+    // Fills the slot -> pool table from slot `from` up, sized to slot_count().
+    void map_pools(std::size_t from) {
+        if (pools.empty()) return;
+        std::size_t n = slot_count();
+        resize_amortized(pooled, n, kNoPool);
+        for (std::size_t i = 0; i < pools.size(); ++i) {
+            std::size_t end = std::min(pools[i].end, n);
+            for (std::size_t s = std::max(pools[i].first, from); s < end; ++s) pooled[s] = static_cast<std::uint32_t>(i);
+        }
+    }
+
+    // Rebuilds the gaps between pools that the default allocator draws from.
+    void fence_pools() {
+        std::vector<Pool> by_slot(pools);
+        std::sort(by_slot.begin(), by_slot.end(), [](const Pool& a, const Pool& b) { return a.first < b.first; });
+        std::vector<Gap> gaps;
+        std::size_t at = 0;
+        for (const Pool& p : by_slot) {
+            if (p.first > at) gaps.push_back(Gap{at, p.first});
+            at = p.end;
+        }
+        gaps.push_back(Gap{at, npos}); // the rest, however far the range grows
+        open.swap(gaps);
+    }
+
+    static std::size_t span(const Segment& seg) {
+        return static_cast<std::size_t>(seg.last) - static_cast<std::size_t>(seg.first) + 1;
+    }
+
+    int successor(int pid, bool allocated) const {
+        if (!initialized_) return -1;
+        int top = allocated ? max_pid : pid_limit;
+        if (pid > top) return -1;
+        std::size_t n = slots_through(top);
+        std::size_t from = slot_at_or_after(pid);
+        if (!allocated) {
+            std::size_t slot = storage.find_clear(from, n);
+            return slot >= n ? -1 : pid_of(slot);
+        }
+        std::size_t slot = storage.find_set(from, n);
+        while (slot < n && is_reserved(slot)) slot = storage.find_set(slot + 1, n);
+        return slot >= n ? -1 : pid_of(slot);
+    }
+
+    // Records metadata for a new PID; the parent is linked only if it is live.
+    void record(std::size_t slot, std::uint32_t owner, int parent) {
+        std::uint32_t at = Metadata::kNil;
+        if (parent != -1 && is_allocated(parent) && !is_zombie(parent) && slot_of(parent) != slot) {
+            at = static_cast<std::uint32_t>(slot_of(parent));
+        } else {
+            parent = -1;
+        }
+        meta.record(slot, owner, parent, at);
+    }
+
+    void uncharge_all() {
+        if (!limits) return;
+        for (std::uint32_t& g : charged) {
+            if (g != kUncharged) limits->uncharge(static_cast<int>(g));
+            g = kUncharged;
+        }
+    }
+
+    bool is_reserved(std::size_t slot) const {
+        return reserved_count != 0 && reserved.test(slot);
+    }
+
+    bool take_reservation(int token, std::size_t& slot) {
+        if (!initialized_ || !contains(token, max_pid)) return false;
+        slot = slot_of(token);
+        if (!is_reserved(slot)) return false;
+        reserved.clear(slot);
+        --reserved_count;
+        return true;
+    }
+
+    void free_slot(std::size_t slot) {
+        if (!storage.test(slot)) return;
+        storage.clear(slot);
+        --live;
+        if (limits && charged[slot] != kUncharged) {
+            limits->uncharge(static_cast<int>(charged[slot]));
+            charged[slot] = kUncharged;
+        }
+        if (exited_count != 0 && exited.test(slot)) {
+            exited.clear(slot);
+            --exited_count;
+        }
+        if (meta_enabled) {
+            // Orphans go to the grandparent, or become roots.
+            meta.move_children(slot, meta.parent_slot[slot], meta.parent[slot]);
+            meta.detach(slot);
+            meta.poison(slot);
+        }
+        if (pooled.empty() || pooled[slot] == kNoPool) {
+            if (slot < next) next = slot; // bias to reuse earlier frees
+        } else {
+            Pool& p = pools[pooled[slot]];
+            if (slot < p.cursor) p.cursor = slot;
+        }
+        if (slot >= capacity()) finish_shrink();
+    }
+
+    // Cuts the storage down to pid_limit once nothing above it is live.
+    bool finish_shrink() {
+        if (max_pid == pid_limit) return true;
+        std::size_t keep = capacity();
+        if (storage.find_set(keep, slot_count()) != slot_count()) return false;
+        storage.resize(keep);
+        exited.resize(keep);
+        reserved.resize(keep);
+        if (limits) charged.resize(keep);
+        if (!pooled.empty()) pooled.resize(keep);
+        if (meta_enabled) meta.resize(keep);
+        set_extent(pid_limit);
+        return true;
+    }
+
+    void set_extent(int top) {
+        max_pid = top;
+        segments.back().last = top;
+    }
+
+    // True if pid lies in one of the intervals and is <= top.
+    bool contains(int pid, int top) const {
+        if (pid < min_pid || pid > top) return false;
+        if (segments.size() == 1) return true;
+        return pid <= segment_of(pid).last;
+    }
+
+    // Last segment starting at or before pid (pid >= min_pid).
+    const Segment& segment_of(int pid) const {
+        auto it = std::upper_bound(segments.begin(), segments.end(), pid,
+                                   [](int p, const Segment& seg) { return p < seg.first; });
+        return *(it - 1);
+    }
+
+    // Slot of the first PID >= pid that lies in an interval.
+    std::size_t slot_at_or_after(int pid) const {
+        if (pid <= min_pid) return 0;
+        const Segment& seg = segment_of(pid);
+        if (pid <= seg.last) return seg.base + static_cast<std::size_t>(pid - seg.first);
+        return seg.base + span(seg); // in a hole (or past the end): start of the next interval
+    }
+
+    // Number of slots covering every PID <= top (top inside the last interval).
+    std::size_t slots_through(int top) const {
+        const Segment& seg = segments.back();
+        return seg.base + static_cast<std::size_t>(top - seg.first) + 1;
+    }
+
+    std::size_t slot_count() const { return slots_through(max_pid); }
+
+    std::size_t slot_of(int pid) const {
+        if (segments.size() == 1) return static_cast<std::size_t>(pid - min_pid);
+        const Segment& seg = segment_of(pid);
+        return seg.base + static_cast<std::size_t>(pid - seg.first);
+    }
+
+    int pid_of(std::size_t slot) const {
+        if (segments.size() == 1) return min_pid + static_cast<int>(slot);
+        auto it = std::upper_bound(segments.begin(), segments.end(), slot,
+                                   [](std::size_t s, const Segment& seg) { return s < seg.base; });
+        const Segment& seg = *(it - 1);
+        return seg.first + static_cast<int>(slot - seg.base);
+    }
+
+    std::vector<Segment> segments; // sorted, disjoint, non-adjacent
+    std::vector<Pool> pools;       // indexed by pool id
+    static constexpr std::uint32_t kNoPool = 0xFFFFFFFFu;
+    std::vector<std::uint32_t> pooled; // slot -> pool id, when pools are defined
+    std::vector<Gap> open;         // sorted slot ranges between pools; empty without pools
     int min_pid;
-    int max_pid;
-    std::vector<unsigned char> bitmap;
-    int next;
+    int max_pid;   // top of the storage; above pid_limit only while a shrink is pending
+    int pid_limit; // top of the allocatable range
+    Storage storage;
+    Storage exited;                    // zombies, a subset of storage
+    std::size_t exited_count = 0;
+    static constexpr std::uint32_t kUncharged = 0xFFFFFFFFu;
+    PIDLimitGroups* limits = nullptr;
+    std::vector<std::uint32_t> charged; // slot -> limit group, when limits are attached
+    std::size_t next; // allocation cursor, as a slot
     bool initialized_;
+    bool meta_enabled = false;
+    Metadata meta;
+    std::size_t live = 0;              // slots set in storage, reservations included
+    Storage reserved;                  // outstanding reserve_pid() slots, a subset of storage
+    std::size_t reserved_count = 0;
+    std::vector<std::size_t> spare;    // aborted slots, reused first by reserve_pid()
 };
+
+using PIDManager = BasicPIDManager<BitmapStorage>;
+using BitmapPIDManager = PIDManager;
+using ByteMapPIDManager = BasicPIDManager<ByteMapStorage>;
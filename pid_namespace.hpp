@@ -0,0 +1,172 @@
+#pragma once
+#include <vector>
+#include <stdexcept>
+#include <cstddef>
+#include "pid_manager.hpp"
+
+// Linux-style nested PID namespaces.
+//
+// Namespace 0 is the root; its PIDs are the global PIDs. Every other
+// namespace has a parent and its own PIDManager, so a process created in a
+// namespace at depth L holds L + 1 PIDs: one in its own namespace and one in
+// each ancestor. alloc() takes all of them in one call, or none.
+//
+// Translation never goes through a node-based map:
+//   local -> global : each namespace keeps a flat table indexed by
+//                     local - min, holding the global PID
+//   global -> local : the root keeps a flat table from global slot to a
+//                     process record; records store the PID at every level
+//                     contiguously (stride = max_depth + 1), so the local
+//                     PID in any ancestor is one indexed load
+class PIDNamespaceTree {
+public:
+    explicit PIDNamespaceTree(int minPid = MIN_PID, int maxPid = MAX_PID, int maxDepth = 32)
+        : stride(static_cast<std::size_t>(maxDepth) + 1) {
+        if (maxDepth < 0) throw std::invalid_argument("Invalid namespace depth");
+        add_namespace(-1, 0, minPid, maxPid);
+        proc_of.assign(ns[0].local_to_global.size(), -1);
+    }
+
+    // Creates a child namespace of `parent` with its own PID range (Linux
+    // starts every namespace at 1, its init). Returns the new namespace id,
+    // or -1 if the parent is invalid or the tree is already max_depth deep.
+    int create_namespace(int parent, int minPid = 1, int maxPid = MAX_PID) {
+        if (!valid(parent)) return -1;
+        int level = ns[static_cast<std::size_t>(parent)].level + 1;
+        if (static_cast<std::size_t>(level) >= stride) return -1;
+        if (minPid < 0 || maxPid < minPid) return -1;
+        add_namespace(parent, level, minPid, maxPid);
+        return static_cast<int>(ns.size() - 1);
+    }
+
+    // Allocates a PID in `id` and in every ancestor up to the root.
+    // Returns the global PID, or -1 if `id` is invalid or any level is
+    // exhausted (PIDs already taken at lower levels are given back).
+    int alloc(int id) {
+        if (!valid(id)) return -1;
+        int level = ns[static_cast<std::size_t>(id)].level;
+        std::size_t proc = take_record();
+        int* nums = &numbers[proc * stride];
+
+        int cur = id;
+        for (int l = level; l >= 0; --l) {
+            Namespace& n = ns[static_cast<std::size_t>(cur)];
+            nums[l] = n.mgr.allocate_pid();
+            if (nums[l] == -1) {
+                for (int undo = level, u = id; undo > l; --undo) {
+                    ns[static_cast<std::size_t>(u)].mgr.release_pid(nums[undo]);
+                    u = ns[static_cast<std::size_t>(u)].parent;
+                }
+                free_records.push_back(proc);
+                return -1;
+            }
+            cur = n.parent;
+        }
+
+        int global = nums[0];
+        cur = id;
+        for (int l = level; l >= 0; --l) {
+            Namespace& n = ns[static_cast<std::size_t>(cur)];
+            n.local_to_global[static_cast<std::size_t>(nums[l] - n.mgr.min())] = global;
+            cur = n.parent;
+        }
+        proc_ns[proc] = id;
+        proc_of[global_slot(global)] = static_cast<int>(proc);
+        return global;
+    }
+
+    // Releases a process's PIDs in its namespace and every ancestor.
+    // Safe no-op for a global PID that isn't live.
+    void release(int global) {
+        int proc = record_of(global);
+        if (proc < 0) return;
+        const int* nums = &numbers[static_cast<std::size_t>(proc) * stride];
+        int cur = proc_ns[static_cast<std::size_t>(proc)];
+        for (int l = ns[static_cast<std::size_t>(cur)].level; l >= 0; --l) {
+            Namespace& n = ns[static_cast<std::size_t>(cur)];
+            n.local_to_global[static_cast<std::size_t>(nums[l] - n.mgr.min())] = -1;
+            n.mgr.release_pid(nums[l]);
+            cur = n.parent;
+        }
+        proc_of[global_slot(global)] = -1;
+        free_records.push_back(static_cast<std::size_t>(proc));
+    }
+
+    // The PID `global` has inside namespace `id`, or -1 if the process
+    // isn't visible there (it lives in an unrelated or ancestor namespace).
+    int to_local(int global, int id) const {
+        if (!valid(id)) return -1;
+        int proc = record_of(global);
+        if (proc < 0) return -1;
+        const Namespace& n = ns[static_cast<std::size_t>(id)];
+        if (n.level > ns[static_cast<std::size_t>(proc_ns[static_cast<std::size_t>(proc)])].level) return -1;
+        int local = numbers[static_cast<std::size_t>(proc) * stride + static_cast<std::size_t>(n.level)];
+        // Same level in another branch holds a different process's number.
+        return n.local_to_global[static_cast<std::size_t>(local - n.mgr.min())] == global ? local : -1;
+    }
+
+    // The global PID of `local` in namespace `id`, or -1 if it isn't live.
+    int to_global(int local, int id) const {
+        if (!valid(id)) return -1;
+        const Namespace& n = ns[static_cast<std::size_t>(id)];
+        if (!n.mgr.in_range(local)) return -1;
+        return n.local_to_global[static_cast<std::size_t>(local - n.mgr.min())];
+    }
+
+    // The namespace a live global PID was created in, or -1.
+    int namespace_of(int global) const {
+        int proc = record_of(global);
+        return proc < 0 ? -1 : proc_ns[static_cast<std::size_t>(proc)];
+    }
+
+    int parent(int id) const { return valid(id) ? ns[static_cast<std::size_t>(id)].parent : -1; }
+    int level(int id) const { return valid(id) ? ns[static_cast<std::size_t>(id)].level : -1; }
+    std::size_t namespace_count() const { return ns.size(); }
+    const PIDManager& manager(int id) const { return ns.at(static_cast<std::size_t>(id)).mgr; }
+
+private:
+    struct Namespace {
+        Namespace(int p, int l, int minPid, int maxPid) : parent(p), level(l), mgr(minPid, maxPid) {}
+        int parent;
+        int level;
+        PIDManager mgr;
+        std::vector<int> local_to_global; // indexed by local - mgr.min(), -1 if free
+    };
+
+    void add_namespace(int parent, int level, int minPid, int maxPid) {
+        ns.emplace_back(parent, level, minPid, maxPid);
+        Namespace& n = ns.back();
+        if (n.mgr.allocate_map() != 1) {
+            ns.pop_back();
+            throw std::runtime_error("Failed to initialize namespace PID map");
+        }
+        n.local_to_global.assign(static_cast<std::size_t>(maxPid - minPid) + 1, -1);
+    }
+
+    bool valid(int id) const { return id >= 0 && static_cast<std::size_t>(id) < ns.size(); }
+
+    std::size_t global_slot(int global) const { return static_cast<std::size_t>(global - ns[0].mgr.min()); }
+
+    int record_of(int global) const {
+        if (!ns[0].mgr.in_range(global)) return -1;
+        return proc_of[global_slot(global)];
+    }
+
+    std::size_t take_record() {
+        if (!free_records.empty()) {
+            std::size_t proc = free_records.back();
+            free_records.pop_back();
+            return proc;
+        }
+        proc_ns.push_back(-1);
+        numbers.resize(numbers.size() + stride, -1);
+        return proc_ns.size() - 1;
+    }
+
+    std::size_t stride;                   // max_depth + 1 PIDs per process record
+    std::vector<Namespace> ns;            // indexed by namespace id
+    std::vector<int> proc_of;             // global slot -> process record, -1 if free
+    std::vector<int> proc_ns;             // process record -> namespace it was created in
+    std::vector<int> numbers;             // process record * stride + level -> PID at that level
+    std::vector<std::size_t> free_records;
+};
@@ -0,0 +1,253 @@
+#pragma once
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <cerrno>
+#include <algorithm>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <sys/un.h>
+#include "pid_manager.hpp"
+
+#ifndef SO_PEERPIDFD
+#define SO_PEERPIDFD 77 // Linux 6.5
+#endif
+
+// Framed wire protocol for the PID service.
+//
+// Every message is an 8-byte header followed by `count` 32-bit PIDs:
+//   kAlloc   count = PIDs wanted, no payload      (client -> server)
+//   kRelease count PIDs to give back             (client -> server)
+//   kDone    count = 0                           (client -> server)
+//   kPids    the PIDs granted for one kAlloc     (server -> client)
+// A kPids reply can hold fewer PIDs than asked for, or none, when the map
+// runs low. Both sides read into large buffers and decode as many frames as
+// arrived, so a batch of requests costs one read() and one write() instead
+// of a syscall per byte-sized opcode. Integers are in host byte order: the
+// service is local only.
+//
+// Every header carries the protocol version and a request id the client
+// picks. A kPids reply carries the id of the kAlloc it answers, so a client
+// may keep any number of requests in flight and must match replies by id,
+// not by arrival order. A frame of another version is malformed: the
+// server drops the client rather than guess at the layout. (Version 1 had
+// a 4-byte header and no ids.)
+//
+// Over a SOCK_SEQPACKET socket each frame is exactly one datagram, so the
+// kernel keeps the boundaries; send_frames() and the server batch several
+// datagrams per sendmmsg/recvmmsg call.
+namespace pid_protocol {
+
+enum Op : std::uint8_t { kAlloc = 1, kRelease = 2, kDone = 3, kPids = 4 };
+
+constexpr std::uint8_t kVersion = 2;
+
+struct Header {
+    std::uint8_t op;
+    std::uint8_t version;
+    std::uint16_t count;
+    std::uint32_t id;      // request id; echoed in the reply
+};
+static_assert(sizeof(Header) == 8, "wire header must be 8 bytes");
+
+constexpr std::size_t kMaxBatch = 1024; // most PIDs in one frame
+
+inline bool carries_pids(std::uint8_t op) { return op == kRelease || op == kPids; }
+
+inline std::size_t frame_size(const Header& h) {
+    return sizeof(Header) + (carries_pids(h.op) ? h.count * sizeof(std::int32_t) : 0);
+}
+
+constexpr std::size_t kMaxFrame = sizeof(Header) + kMaxBatch * sizeof(std::int32_t);
+
+inline bool valid_header(const Header& h) {
+    return h.version == kVersion && h.op >= kAlloc && h.op <= kPids && h.count <= kMaxBatch;
+}
+
+// Decodes a datagram that must hold exactly one frame.
+// Returns 1 and fills h/pids, or -1 if it doesn't.
+inline int parse_frame(const char* data, std::size_t n, Header& h, std::vector<int>& pids) {
+    if (n < sizeof(Header)) return -1;
+    std::memcpy(&h, data, sizeof h);
+    if (!valid_header(h) || frame_size(h) != n) return -1;
+    pids.resize(carries_pids(h.op) ? h.count : 0);
+    if (!pids.empty()) std::memcpy(pids.data(), data + sizeof h, pids.size() * sizeof(std::int32_t));
+    return 1;
+}
+
+// Appends one frame to `out`. `pids` is read only for ops that carry PIDs.
+inline void append(std::vector<char>& out, Op op, std::size_t count, const int* pids = nullptr,
+                   std::uint32_t id = 0) {
+    Header h{op, kVersion, static_cast<std::uint16_t>(count), id};
+    std::size_t at = out.size();
+    out.resize(at + frame_size(h));
+    std::memcpy(&out[at], &h, sizeof h);
+    if (carries_pids(op) && count > 0) {
+        std::memcpy(&out[at + sizeof h], pids, count * sizeof(std::int32_t));
+    }
+}
+
+// Accumulates bytes from a stream and hands back whole frames.
+class Decoder {
+public:
+    // Appends raw bytes, e.g. from a read() the caller made itself.
+    void feed(const char* data, std::size_t n) {
+        compact();
+        buf.insert(buf.end(), data, data + n);
+    }
+
+    // One read() of up to `chunk` bytes from fd. Returns the byte count,
+    // 0 at end of stream, or -1 with errno set (EAGAIN on an empty
+    // non-blocking fd).
+    ssize_t read_from(int fd, std::size_t chunk = 64 * 1024) {
+        compact();
+        std::size_t at = buf.size();
+        buf.resize(at + chunk);
+        ssize_t r;
+        do {
+            r = ::read(fd, &buf[at], chunk);
+        } while (r < 0 && errno == EINTR);
+        buf.resize(at + (r > 0 ? static_cast<std::size_t>(r) : 0));
+        return r;
+    }
+
+    // Decodes the next complete frame. Returns 1 and fills h/pids, 0 if
+    // the frame isn't all here yet, or -1 if the stream is malformed (another
+    // version, an unknown opcode or an oversized batch); the stream is
+    // unusable then.
+    int next(Header& h, std::vector<int>& pids) {
+        if (buf.size() - pos < sizeof(Header)) return 0;
+        std::memcpy(&h, &buf[pos], sizeof h);
+        if (!valid_header(h)) return -1;
+        std::size_t size = frame_size(h);
+        if (buf.size() - pos < size) return 0;
+        pids.resize(carries_pids(h.op) ? h.count : 0);
+        if (!pids.empty()) std::memcpy(pids.data(), &buf[pos + sizeof h], pids.size() * sizeof(std::int32_t));
+        pos += size;
+        return 1;
+    }
+
+    std::size_t buffered() const { return buf.size() - pos; }
+
+private:
+    // Drops consumed bytes so the buffer doesn't grow without bound.
+    void compact() {
+        if (pos == 0) return;
+        buf.erase(buf.begin(), buf.begin() + static_cast<std::ptrdiff_t>(pos));
+        pos = 0;
+    }
+
+    std::vector<char> buf;
+    std::size_t pos = 0;
+};
+
+// Server side of one frame: updates `mgr` on behalf of client `owner` and
+// appends any reply to `out`, tagged with the request's id. Allocations are
+// granted in one batch call, as many as are free. Returns 1 to keep serving, 0 on kDone, -1 on a
+// frame a client may not send.
+inline int serve(PIDManager& mgr, std::uint32_t owner, const Header& h,
+                 const std::vector<int>& pids, std::vector<char>& out) {
+    switch (h.op) {
+    case kAlloc: {
+        std::size_t want = std::min<std::size_t>(h.count, mgr.free_count());
+        std::vector<int> got;
+        if (want > 0 && mgr.allocate_atomic(static_cast<int>(want), got, owner) != 1) got.clear();
+        append(out, kPids, got.size(), got.data(), h.id);
+        return 1;
+    }
+    case kRelease:
+        // Only the owner may give a PID back.
+        for (int pid : pids) {
+            PIDInfo info;
+            if (!mgr.has_metadata() || (mgr.get_info(pid, info) && info.owner == owner)) mgr.release_pid(pid);
+        }
+        return 1;
+    case kDone:
+        return 0;
+    default:
+        return -1;
+    }
+}
+
+// Writes all of `data`, retrying on short writes and EINTR.
+// Returns 1, or -1 on error.
+inline int write_all(int fd, const char* data, std::size_t n) {
+    while (n > 0) {
+        ssize_t w = ::write(fd, data, n);
+        if (w < 0) {
+            if (errno == EINTR) continue;
+            return -1;
+        }
+        data += w;
+        n -= static_cast<std::size_t>(w);
+    }
+    return 1;
+}
+
+// Connects to a PID server's SOCK_SEQPACKET listener. Returns the fd, or -1.
+inline int connect_unix(const char* path) {
+    sockaddr_un addr{};
+    if (std::strlen(path) >= sizeof addr.sun_path) return -1;
+    int fd = ::socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+    if (fd == -1) return -1;
+    addr.sun_family = AF_UNIX;
+    std::strcpy(addr.sun_path, path);
+    if (::connect(fd, reinterpret_cast<const sockaddr*>(&addr), sizeof addr) == -1) {
+        ::close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+// Opens a pidfd for the process at the other end of connected AF_UNIX
+// socket `fd`. SO_PEERPIDFD names the process that connected, even if it
+// has exited and its PID been reused since; older kernels only give the
+// PID (SO_PEERCRED), which is opened here and can race with reuse.
+// Returns the pidfd, or -1.
+inline int peer_pidfd(int fd) {
+    int pidfd = -1;
+    socklen_t len = sizeof pidfd;
+    if (getsockopt(fd, SOL_SOCKET, SO_PEERPIDFD, &pidfd, &len) == 0) return pidfd;
+    if (errno != ENOPROTOOPT) return -1; // ESRCH: the peer is already gone
+    ucred cred{};
+    len = sizeof cred;
+    if (getsockopt(fd, SOL_SOCKET, SO_PEERCRED, &cred, &len) == -1 || cred.pid <= 0) return -1;
+    return static_cast<int>(syscall(SYS_pidfd_open, cred.pid, 0));
+}
+
+// Sends a buffer of frames (built with append) on a SOCK_SEQPACKET socket,
+// one datagram per frame and up to 64 datagrams per sendmmsg call.
+// Returns 1, or -1 on error.
+inline int send_frames(int fd, const std::vector<char>& frames) {
+    constexpr unsigned kBurst = 64;
+    mmsghdr msgs[kBurst];
+    iovec iov[kBurst];
+    std::size_t at = 0;
+    while (at < frames.size()) {
+        unsigned n = 0;
+        std::size_t end = at;
+        while (n < kBurst && end + sizeof(Header) <= frames.size()) {
+            Header h;
+            std::memcpy(&h, &frames[end], sizeof h);
+            iov[n].iov_base = const_cast<char*>(&frames[end]);
+            iov[n].iov_len = frame_size(h);
+            msgs[n] = mmsghdr{};
+            msgs[n].msg_hdr.msg_iov = &iov[n];
+            msgs[n].msg_hdr.msg_iovlen = 1;
+            end += iov[n].iov_len;
+            ++n;
+        }
+        if (n == 0) return -1; // a truncated frame at the end
+        int sent = ::sendmmsg(fd, msgs, n, MSG_NOSIGNAL);
+        if (sent < 0) {
+            if (errno == EINTR) continue;
+            return -1;
+        }
+        for (int i = 0; i < sent; ++i) at += iov[i].iov_len;
+    }
+    return 1;
+}
+
+} // namespace pid_protocol
@@ -0,0 +1,461 @@
+#pragma once
+#include <vector>
+#include <string>
+#include <stdexcept>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <cerrno>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <sys/un.h>
+#include "pid_manager.hpp"
+#include "pid_protocol.hpp"
+#include "pid_log.hpp"
+
+// Event-driven PID server: one thread multiplexes any number of client
+// connections with epoll and non-blocking I/O.
+//
+// A connection is a request fd and a reply fd (a pipe pair, or the same fd
+// twice for a socket). On each wakeup a client gets a bounded number of
+// reads; every complete frame in them is served and the replies go out in
+// one write. If a client stops reading its replies, its requests are left
+// unread once kMaxPending bytes of replies are queued, so it only blocks
+// itself. Each client is its own owner id in the manager (1, 2, ...).
+//
+// Clients can also connect to a local AF_UNIX SOCK_SEQPACKET listener, so
+// unrelated processes can use the service. On those connections every frame
+// is one datagram: requests are harvested with recvmmsg and replies sent
+// with sendmmsg, several datagrams per call.
+//
+// A client's process can be watched through a pidfd in the same epoll set
+// (watch_process, or watch_peers for accepted sockets). When it exits,
+// everything its owner id holds is freed in one release_all(), which walks
+// the owner's own list: O(PIDs it owned), with no polling and no scan. A
+// client that crashed before sending Release and Done leaks nothing.
+//
+// Writing to a pipe client that has gone away raises SIGPIPE; processes
+// running a server should ignore it.
+class PIDServer {
+public:
+    static constexpr std::size_t kReadsPerWakeup = 4;
+    static constexpr std::size_t kMaxPending = 1 << 20;
+    static constexpr unsigned kBurst = 32; // datagrams per recvmmsg / sendmmsg
+
+    explicit PIDServer(PIDManager& manager) : mgr(manager) {
+        epfd = epoll_create1(EPOLL_CLOEXEC);
+        if (epfd == -1) throw std::runtime_error("epoll_create1 failed");
+    }
+
+    ~PIDServer() {
+        close_listener();
+        for (Client& c : clients) {
+            if (c.open) close_fds(c);
+            if (c.pidfd != -1) ::close(c.pidfd);
+        }
+        ::close(epfd);
+    }
+
+    PIDServer(const PIDServer&) = delete;
+    PIDServer& operator=(const PIDServer&) = delete;
+
+    // Takes ownership of a connection and makes it non-blocking. A
+    // SOCK_SEQPACKET socket (passed as both fds) is served a datagram per
+    // frame. Returns the client's id, which is also its owner id in the
+    // manager, or -1.
+    int add_client(int in_fd, int out_fd) {
+        if (set_nonblocking(in_fd) == -1 || (out_fd != in_fd && set_nonblocking(out_fd) == -1)) return -1;
+        int type = 0;
+        socklen_t len = sizeof type;
+        bool datagram = in_fd == out_fd && getsockopt(in_fd, SOL_SOCKET, SO_TYPE, &type, &len) == 0 &&
+                        type == SOCK_SEQPACKET;
+        clients.emplace_back();
+        Client& c = clients.back();
+        c.in = in_fd;
+        c.out = out_fd;
+        c.datagram = datagram;
+        c.id = static_cast<std::uint32_t>(clients.size());
+        c.open = true;
+        if (arm(c) == -1) {
+            clients.pop_back();
+            return -1;
+        }
+        ++open_count;
+        return static_cast<int>(c.id);
+    }
+
+    // Listens for SOCK_SEQPACKET clients on `path`, replacing any stale
+    // socket file there. Returns 1, or -1.
+    int listen_unix(const char* path) {
+        sockaddr_un addr{};
+        if (listen_fd != -1 || std::strlen(path) >= sizeof addr.sun_path) return -1;
+        int fd = ::socket(AF_UNIX, SOCK_SEQPACKET | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+        if (fd == -1) return -1;
+        addr.sun_family = AF_UNIX;
+        std::strcpy(addr.sun_path, path);
+        ::unlink(path);
+        epoll_event ev{};
+        ev.events = EPOLLIN;
+        ev.data.u64 = 0; // client ids start at 1
+        if (::bind(fd, reinterpret_cast<const sockaddr*>(&addr), sizeof addr) == -1 ||
+            ::listen(fd, SOMAXCONN) == -1 || epoll_ctl(epfd, EPOLL_CTL_ADD, fd, &ev) == -1) {
+            ::close(fd);
+            return -1;
+        }
+        listen_fd = fd;
+        listen_path = path;
+        return 1;
+    }
+
+    // Watches process `pid` on behalf of client `id`: when it exits, the
+    // client's connection is dropped and every PID it owns is released
+    // (metadata must be on). Returns 1, or -1 (unknown client, already
+    // watched, or no such process).
+    int watch_process(int id, pid_t pid) {
+        if (id < 1 || static_cast<std::size_t>(id) > clients.size()) return -1;
+        if (clients[static_cast<std::size_t>(id) - 1].pidfd != -1) return -1;
+        return watch_pidfd(id, static_cast<int>(syscall(SYS_pidfd_open, pid, 0)));
+    }
+
+    // Watches the process behind every socket client accepted from now on
+    // (see pid_protocol::peer_pidfd).
+    void watch_peers(bool on) { watch_accepted = on; }
+
+    // Stops accepting and removes the socket file. Connected clients stay.
+    void close_listener() {
+        if (listen_fd == -1) return;
+        epoll_ctl(epfd, EPOLL_CTL_DEL, listen_fd, nullptr);
+        ::close(listen_fd);
+        ::unlink(listen_path.c_str());
+        listen_fd = -1;
+    }
+
+    // Waits up to timeout_ms (-1: forever) and serves every ready client.
+    // Returns the number of events handled, or -1 on error.
+    int poll_once(int timeout_ms) {
+        epoll_event events[64];
+        int n = epoll_wait(epfd, events, 64, timeout_ms);
+        if (n < 0) return errno == EINTR ? 0 : -1;
+        for (int i = 0; i < n; ++i) {
+            if (events[i].data.u64 == 0) {
+                accept_clients();
+                continue;
+            }
+            if (events[i].data.u64 & kProcessTag) {
+                on_exit(clients[static_cast<std::size_t>(events[i].data.u64 & ~kProcessTag) - 1]);
+                continue;
+            }
+            Client& c = clients[static_cast<std::size_t>(events[i].data.u64 >> 1) - 1];
+            if (!c.open) continue;
+            bool out_side = (events[i].data.u64 & 1) != 0;
+            std::uint32_t ev = events[i].events;
+            if ((ev & EPOLLOUT) || (out_side && (ev & (EPOLLERR | EPOLLHUP)))) flush(c);
+            if (c.open && !out_side && (ev & (EPOLLIN | EPOLLHUP | EPOLLERR))) on_readable(c);
+            if (c.open) settle(c);
+        }
+        return n;
+    }
+
+    // Serves until every client has disconnected. Returns 1, or -1 on error.
+    int run() {
+        while (open_count > 0) {
+            if (poll_once(-1) == -1) return -1;
+        }
+        return 1;
+    }
+
+    // Records requests and client exits in `events` (see pid_log.hpp) when
+    // set; nullptr turns logging off. The log must outlive the server, or
+    // be unset first.
+    void set_log(pid_log::EventLog* events) { log = events; }
+
+    std::size_t client_count() const { return open_count; }
+    // Every client ever added or accepted, connected or not.
+    std::size_t clients_seen() const { return clients.size(); }
+    std::uint64_t frames_served() const { return frames; }
+    // Client processes still being watched.
+    std::size_t watching() const { return watched; }
+    // PIDs freed because their client's process exited holding them.
+    std::uint64_t reclaimed() const { return reclaimed_total; }
+
+private:
+    static constexpr std::uint64_t kProcessTag = std::uint64_t(1) << 63; // pidfd events
+    struct Client {
+        int in = -1;
+        int out = -1;
+        std::uint32_t id = 0;
+        bool open = false;
+        bool datagram = false;        // SOCK_SEQPACKET: one frame per datagram
+        bool closing = false;         // Done, EOF or a protocol error: flush, then close
+        std::uint32_t in_events = 0;  // currently registered interest
+        std::uint32_t out_events = 0;
+        pid_protocol::Decoder requests;
+        std::vector<char> replies;
+        std::size_t sent = 0;         // bytes of replies already written
+        int pidfd = -1;               // the client's process, if watched
+        std::size_t pending() const { return replies.size() - sent; }
+    };
+
+    static int set_nonblocking(int fd) {
+        int flags = fcntl(fd, F_GETFL);
+        return flags == -1 ? -1 : fcntl(fd, F_SETFL, flags | O_NONBLOCK);
+    }
+
+    // Moves a registration between no interest (not in the set) and `want`.
+    int interest(int fd, std::uint32_t& have, std::uint32_t want, std::uint64_t tag) {
+        if (have == want) return 0;
+        epoll_event ev{};
+        ev.events = want;
+        ev.data.u64 = tag;
+        int op = have == 0 ? EPOLL_CTL_ADD : want == 0 ? EPOLL_CTL_DEL : EPOLL_CTL_MOD;
+        if (epoll_ctl(epfd, op, fd, &ev) == -1) return -1;
+        have = want;
+        return 0;
+    }
+
+    // Reads while below the reply limit, writes while replies are queued.
+    // Unwatched fds are left out of the set entirely, so a hung-up pipe
+    // can't keep waking us.
+    int arm(Client& c) {
+        std::uint32_t want_in = !c.closing && c.pending() < kMaxPending ? std::uint32_t(EPOLLIN) : 0;
+        std::uint32_t want_out = c.pending() > 0 ? std::uint32_t(EPOLLOUT) : 0;
+        std::uint64_t tag = static_cast<std::uint64_t>(c.id) << 1;
+        if (c.in == c.out) return interest(c.in, c.in_events, want_in | want_out, tag);
+        if (interest(c.in, c.in_events, want_in, tag) == -1) return -1;
+        return interest(c.out, c.out_events, want_out, tag | 1);
+    }
+
+    void accept_clients() {
+        for (;;) {
+            int fd = ::accept4(listen_fd, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+            if (fd == -1) {
+                if (errno == EINTR || errno == ECONNABORTED) continue;
+                return; // EAGAIN: backlog drained
+            }
+            int id = add_client(fd, fd);
+            if (id == -1) {
+                ::close(fd);
+                continue;
+            }
+            if (watch_accepted) watch_pidfd(id, pid_protocol::peer_pidfd(fd));
+        }
+    }
+
+    // Adds client `id`'s pidfd `fd` (taken over, -1 allowed) to the set.
+    int watch_pidfd(int id, int fd) {
+        if (fd == -1) return -1;
+        Client& c = clients[static_cast<std::size_t>(id) - 1];
+        epoll_event ev{};
+        ev.events = EPOLLIN; // readable once the process has exited
+        ev.data.u64 = kProcessTag | static_cast<std::uint64_t>(id);
+        if (epoll_ctl(epfd, EPOLL_CTL_ADD, fd, &ev) == -1) {
+            ::close(fd);
+            return -1;
+        }
+        c.pidfd = fd;
+        ++watched;
+        return 1;
+    }
+
+    // The client's process is gone: drop the connection, unserved frames
+    // and all, and free whatever it still owned. The pidfd stays watched
+    // after a clean disconnect, so a client that sent Done without
+    // releasing everything is cleaned up here too.
+    void on_exit(Client& c) {
+        epoll_ctl(epfd, EPOLL_CTL_DEL, c.pidfd, nullptr);
+        ::close(c.pidfd);
+        c.pidfd = -1;
+        --watched;
+        disconnect(c);
+        std::size_t freed = mgr.release_all(c.id);
+        reclaimed_total += freed;
+        if (log && freed > 0) log->exited(c.id, static_cast<std::uint32_t>(freed));
+    }
+
+    void on_readable(Client& c) {
+        if (c.datagram) {
+            read_datagrams(c);
+            flush(c);
+            return;
+        }
+        for (std::size_t i = 0; i < kReadsPerWakeup && !c.closing; ++i) {
+            ssize_t r = c.requests.read_from(c.in);
+            if (r > 0) continue;
+            if (r < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) break;
+            c.closing = true; // EOF or a read error
+        }
+        serve_buffered(c);
+        flush(c);
+    }
+
+    // Harvests up to kBurst datagrams per recvmmsg call.
+    void read_datagrams(Client& c) {
+        constexpr std::size_t kSlot = pid_protocol::kMaxFrame + 1; // +1 spots oversized datagrams
+        if (dgrams.size() < kBurst * kSlot) dgrams.resize(kBurst * kSlot);
+        mmsghdr msgs[kBurst];
+        iovec iov[kBurst];
+        for (std::size_t round = 0; round < kReadsPerWakeup && !c.closing && c.pending() < kMaxPending; ++round) {
+            for (unsigned i = 0; i < kBurst; ++i) {
+                iov[i].iov_base = &dgrams[i * kSlot];
+                iov[i].iov_len = kSlot;
+                msgs[i] = mmsghdr{};
+                msgs[i].msg_hdr.msg_iov = &iov[i];
+                msgs[i].msg_hdr.msg_iovlen = 1;
+            }
+            int n = ::recvmmsg(c.in, msgs, kBurst, MSG_DONTWAIT, nullptr);
+            if (n <= 0) {
+                if (n == 0 || (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)) c.closing = true;
+                return;
+            }
+            pid_protocol::Header h{};
+            for (int i = 0; i < n && !c.closing; ++i) {
+                const char* data = &dgrams[static_cast<std::size_t>(i) * kSlot];
+                if (msgs[i].msg_len == 0 ||   // peer closed
+                    pid_protocol::parse_frame(data, msgs[i].msg_len, h, pids) != 1) {
+                    c.closing = true;
+                    break;
+                }
+                if (!serve_one(c, h)) break;
+            }
+            if (n < static_cast<int>(kBurst)) return; // drained
+        }
+    }
+
+    // Frames that arrived before an EOF are still served.
+    void serve_buffered(Client& c) {
+        pid_protocol::Header h{};
+        int r = 0;
+        while (c.pending() < kMaxPending && (r = c.requests.next(h, pids)) == 1) {
+            if (!serve_one(c, h)) return;
+        }
+        if (r == -1) {
+            c.closing = true;
+            c.requests = pid_protocol::Decoder();
+        }
+    }
+
+    // Serves one decoded frame (payload in `pids`). Returns false, and
+    // starts closing the connection, on Done or a frame a client may not send.
+    bool serve_one(Client& c, const pid_protocol::Header& h) {
+        ++frames;
+        std::size_t at = c.replies.size();
+        int served = pid_protocol::serve(mgr, c.id, h, pids, c.replies);
+        if (log) log_request(c, h, at);
+        if (served == 1) return true;
+        c.closing = true;
+        c.requests = pid_protocol::Decoder(); // nothing after Done is served
+        return false;
+    }
+
+    // A fixed-size record into the log's ring; formatting happens on its
+    // own thread.
+    void log_request(const Client& c, const pid_protocol::Header& h, std::size_t reply_at) {
+        if (!log->enabled(pid_log::kDebug)) return;
+        pid_protocol::Header reply{};
+        if (h.op == pid_protocol::kAlloc) std::memcpy(&reply, &c.replies[reply_at], sizeof reply);
+        log->request(c.id, h.id, h.op, h.count, reply.count);
+    }
+
+    void flush(Client& c) {
+        if (c.datagram) {
+            flush_datagrams(c);
+            return;
+        }
+        while (c.pending() > 0) {
+            ssize_t w = ::write(c.out, &c.replies[c.sent], c.pending());
+            if (w > 0) {
+                c.sent += static_cast<std::size_t>(w);
+                continue;
+            }
+            if (w < 0 && errno == EINTR) continue;
+            if (w < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) break;
+            disconnect(c); // the client is gone
+            return;
+        }
+        if (c.pending() == 0) {
+            c.replies.clear();
+            c.sent = 0;
+        }
+    }
+
+    // Sends queued replies one datagram per frame, kBurst per sendmmsg.
+    void flush_datagrams(Client& c) {
+        mmsghdr msgs[kBurst];
+        iovec iov[kBurst];
+        while (c.pending() > 0) {
+            unsigned n = 0;
+            for (std::size_t at = c.sent; n < kBurst && at < c.replies.size(); ++n) {
+                pid_protocol::Header h;
+                std::memcpy(&h, &c.replies[at], sizeof h);
+                iov[n].iov_base = &c.replies[at];
+                iov[n].iov_len = pid_protocol::frame_size(h);
+                msgs[n] = mmsghdr{};
+                msgs[n].msg_hdr.msg_iov = &iov[n];
+                msgs[n].msg_hdr.msg_iovlen = 1;
+                at += iov[n].iov_len;
+            }
+            int sent = ::sendmmsg(c.out, msgs, n, MSG_DONTWAIT | MSG_NOSIGNAL);
+            if (sent < 0) {
+                if (errno == EINTR) continue;
+                if (errno == EAGAIN || errno == EWOULDBLOCK) break;
+                disconnect(c);
+                return;
+            }
+            for (int i = 0; i < sent; ++i) c.sent += iov[i].iov_len;
+        }
+        if (c.pending() == 0) {
+            c.replies.clear();
+            c.sent = 0;
+        }
+    }
+
+    // After a wakeup: finish a closing client, pick up frames left waiting
+    // for reply space, and update what we watch.
+    void settle(Client& c) {
+        if (c.requests.buffered() > 0 && c.pending() < kMaxPending) {
+            serve_buffered(c);
+            flush(c);
+            if (!c.open) return;
+        }
+        if (c.closing && c.pending() == 0) { // whatever is still buffered is a partial frame
+            disconnect(c);
+            return;
+        }
+        if (arm(c) == -1) disconnect(c);
+    }
+
+    void close_fds(Client& c) {
+        ::close(c.in);
+        if (c.out != c.in) ::close(c.out);
+    }
+
+    void disconnect(Client& c) {
+        if (!c.open) return;
+        std::uint32_t none = 0;
+        std::uint64_t tag = static_cast<std::uint64_t>(c.id) << 1;
+        interest(c.in, c.in_events, none, tag);
+        if (c.out != c.in) interest(c.out, c.out_events, none, tag | 1);
+        close_fds(c);
+        c.open = false;
+        c.requests = pid_protocol::Decoder();
+        std::vector<char>().swap(c.replies);
+        --open_count;
+    }
+
+    PIDManager& mgr;
+    int epfd;
+    std::vector<Client> clients; // client id - 1 -> connection
+    std::size_t open_count = 0;
+    std::uint64_t frames = 0;
+    std::vector<int> pids;       // scratch for decoded payloads
+    std::vector<char> dgrams;    // scratch for recvmmsg
+    int listen_fd = -1;
+    std::string listen_path;
+    pid_log::EventLog* log = nullptr;
+    bool watch_accepted = false;
+    std::size_t watched = 0;
+    std::uint64_t reclaimed_total = 0;
+};
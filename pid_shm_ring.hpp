@@ -0,0 +1,670 @@
+#pragma once
+#include <atomic>
+#include <vector>
+#include <new>
+#include <stdexcept>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <cerrno>
+#include <ctime>
+#include <chrono>
+#include <algorithm>
+#include <unistd.h>
+#include <sched.h>
+#include <poll.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+#include "pid_manager.hpp"
+#include "pid_protocol.hpp"
+
+// Shared-memory transport for the PID service.
+//
+// One memfd region holds a slot per client, and each slot holds two
+// single-producer/single-consumer byte rings: requests (client -> server)
+// and replies (server -> client). The rings carry the same frames as the
+// pipe and socket transports. Head and tail sit on their own cache lines.
+// Each side publishes with a release store and reads the other's index
+// with an acquire load, so a busy client and server exchange frames with
+// no syscalls at all.
+//
+// Only a side that has found its ring empty sleeps, on a futex. It first
+// raises its "sleeping" word and then checks the ring once more. A producer
+// checks that word after publishing and calls FUTEX_WAKE only when it is
+// set, which only happens after the ring went empty. The server polls every
+// request ring and sleeps on one region-wide word, so one wake reaches it
+// whichever client wrote.
+//
+// The server can also push PIDs to a client before it asks: each slot has
+// a stash the server tops up from a per-client rate estimate and the client
+// takes from with one CAS, no frame and no wakeup (see Stash).
+//
+// Forked children inherit the mapping. Unrelated processes can mmap fd(),
+// passed to them over a Unix socket.
+namespace pid_shm {
+
+using Word = std::atomic<std::uint32_t>;
+static_assert(sizeof(Word) == sizeof(std::uint32_t) && Word::is_always_lock_free, "futex word layout");
+
+// Shared (not private) futex ops: the word lives in a MAP_SHARED mapping.
+inline void futex_wait(Word& word, std::uint32_t expected, int timeout_ms) {
+    timespec ts{timeout_ms / 1000, static_cast<long>(timeout_ms % 1000) * 1000000L};
+    syscall(SYS_futex, reinterpret_cast<std::uint32_t*>(&word), FUTEX_WAIT, expected,
+            timeout_ms < 0 ? nullptr : &ts, nullptr, 0);
+}
+
+inline void futex_wake(Word& word) {
+    syscall(SYS_futex, reinterpret_cast<std::uint32_t*>(&word), FUTEX_WAKE, 1, nullptr, nullptr, 0);
+}
+
+// Clears a sleeper's flag and wakes it, if it is asleep. The fence orders
+// the caller's publish before the flag check (the sleeper fences the
+// other way round), so either the sleeper sees the data or we see the flag.
+inline void wake_if_sleeping(Word& sleeping) {
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (sleeping.load(std::memory_order_relaxed) != 0) {
+        sleeping.store(0, std::memory_order_relaxed);
+        futex_wake(sleeping);
+    }
+}
+
+// SPSC ring of whole frames. Capacity is a power of two; the bytes follow
+// the header in the mapping.
+class Ring {
+public:
+    void init(std::uint32_t bytes) {
+        head.store(0, std::memory_order_relaxed);
+        tail.store(0, std::memory_order_relaxed);
+        capacity = bytes;
+    }
+
+    // Producer: appends one frame, or nothing if it doesn't fit.
+    bool push(const char* frame, std::size_t n) {
+        std::uint64_t t = tail.load(std::memory_order_relaxed);
+        if (n > capacity - (t - head.load(std::memory_order_acquire))) return false;
+        copy_in(t, frame, n);
+        tail.store(t + n, std::memory_order_release);
+        return true;
+    }
+
+    // Consumer: takes the next frame. Returns 1, 0 if the ring is empty, or
+    // -1 if the producer wrote something that isn't a frame.
+    int pop(pid_protocol::Header& h, std::vector<int>& pids) {
+        std::uint64_t hd = head.load(std::memory_order_relaxed);
+        std::uint64_t avail = tail.load(std::memory_order_acquire) - hd;
+        if (avail == 0) return 0;
+        if (avail < sizeof h) return -1;
+        copy_out(hd, reinterpret_cast<char*>(&h), sizeof h);
+        std::size_t size = pid_protocol::frame_size(h);
+        if (!pid_protocol::valid_header(h) || avail < size) return -1;
+        pids.resize((size - sizeof h) / sizeof(std::int32_t));
+        if (!pids.empty()) copy_out(hd + sizeof h, reinterpret_cast<char*>(pids.data()), size - sizeof h);
+        head.store(hd + size, std::memory_order_release);
+        return 1;
+    }
+
+    bool empty() const {
+        return tail.load(std::memory_order_acquire) == head.load(std::memory_order_relaxed);
+    }
+
+private:
+    char* bytes() { return reinterpret_cast<char*>(this + 1); }
+
+    void copy_in(std::uint64_t at, const char* src, std::size_t n) {
+        std::size_t off = static_cast<std::size_t>(at & (capacity - 1));
+        std::size_t first = std::min<std::size_t>(n, capacity - off);
+        std::memcpy(bytes() + off, src, first);
+        std::memcpy(bytes(), src + first, n - first);
+    }
+
+    void copy_out(std::uint64_t at, char* dst, std::size_t n) {
+        std::size_t off = static_cast<std::size_t>(at & (capacity - 1));
+        std::size_t first = std::min<std::size_t>(n, capacity - off);
+        std::memcpy(dst, bytes() + off, first);
+        std::memcpy(dst + first, bytes(), n - first);
+    }
+
+    alignas(64) std::atomic<std::uint64_t> head;  // written by the consumer only
+    alignas(64) std::atomic<std::uint64_t> tail;  // written by the producer only
+    alignas(64) std::uint32_t capacity;
+};
+static_assert(sizeof(Ring) % 64 == 0, "ring bytes must start on a cache line");
+
+// PIDs the server pushed to one client ahead of demand. The server adds at
+// the tail; the client takes from the head, and the server reclaims what is
+// left by moving the head up to the tail. Head and tail share one word, so
+// a take and a reclaim can't both get the same PID, and both only grow, so
+// a CAS can't be fooled by a stash that was emptied and refilled meanwhile.
+struct Stash {
+    static constexpr std::uint32_t kSize = 1024; // a power of two
+
+    void init() {
+        state.store(0, std::memory_order_relaxed);
+        low.store(0, std::memory_order_relaxed);
+    }
+
+    // Client: takes one PID. Returns it, or -1 if the stash is empty.
+    int take() {
+        std::uint64_t st = state.load(std::memory_order_acquire);
+        for (;;) {
+            std::uint32_t h = head_of(st), t = tail_of(st);
+            if (h == t) return -1;
+            int pid = pids[h & (kSize - 1)].load(std::memory_order_relaxed);
+            if (state.compare_exchange_weak(st, pack(h + 1, t), std::memory_order_acq_rel,
+                                            std::memory_order_acquire)) {
+                return pid;
+            }
+        }
+    }
+
+    // Server: appends up to n PIDs. Returns how many fit.
+    std::size_t push(const int* p, std::size_t n) {
+        std::uint64_t st = state.load(std::memory_order_acquire);
+        std::uint32_t t = tail_of(st);
+        n = std::min<std::size_t>(n, kSize - (t - head_of(st)));
+        for (std::size_t i = 0; i < n; ++i) {
+            pids[(t + i) & (kSize - 1)].store(p[i], std::memory_order_relaxed);
+        }
+        // Only the head can move under us.
+        while (!state.compare_exchange_weak(st, pack(head_of(st), t + static_cast<std::uint32_t>(n)),
+                                            std::memory_order_release, std::memory_order_acquire)) {
+        }
+        return n;
+    }
+
+    // Server: takes back everything the client hasn't taken.
+    void reclaim(std::vector<int>& out) {
+        std::uint64_t st = state.load(std::memory_order_acquire);
+        for (;;) {
+            std::uint32_t h = head_of(st), t = tail_of(st);
+            if (h == t) return;
+            if (state.compare_exchange_weak(st, pack(t, t), std::memory_order_acq_rel, std::memory_order_acquire)) {
+                for (std::uint32_t i = h; i != t; ++i) out.push_back(pids[i & (kSize - 1)].load(std::memory_order_relaxed));
+                return;
+            }
+        }
+    }
+
+    std::size_t level() const {
+        std::uint64_t st = state.load(std::memory_order_acquire);
+        return tail_of(st) - head_of(st);
+    }
+
+    // PIDs taken so far (the head), which tells the server the client's rate.
+    std::uint32_t taken() const { return head_of(state.load(std::memory_order_acquire)); }
+
+    alignas(64) std::atomic<std::uint64_t> state; // head << 32 | tail
+    Word low;                                     // the client wakes the server at this level
+    std::atomic<std::int32_t> pids[kSize];
+
+private:
+    static std::uint32_t head_of(std::uint64_t st) { return static_cast<std::uint32_t>(st >> 32); }
+    static std::uint32_t tail_of(std::uint64_t st) { return static_cast<std::uint32_t>(st); }
+    static std::uint64_t pack(std::uint32_t h, std::uint32_t t) { return static_cast<std::uint64_t>(h) << 32 | t; }
+};
+
+// Per-client slot state. A client claims a free slot (kAttaching), records
+// its pid and only then publishes kAttached, so the server reads the pid of
+// the process that won the slot, never one a refused attacher wrote. A
+// slot no client attached to in time is closed by the server (kDoneState)
+// and can't be attached to afterwards.
+enum SlotState : std::uint32_t { kFree = 0, kAttached = 1, kDoneState = 2, kAttaching = 3 };
+
+struct Slot {
+    alignas(64) Word state;
+    std::atomic<std::int32_t> client_pid; // written while kAttaching, read once kAttached
+    alignas(64) Word client_sleeping;  // client is waiting on its reply ring
+    Stash stash;
+};
+
+// The shared region: a header, then per slot a Slot, a request ring and a
+// reply ring, each ring followed by its bytes.
+class Region {
+public:
+    // Creates a region for `slots` clients with rings of `ring_bytes`
+    // (a power of two, at least one maximal frame).
+    explicit Region(unsigned slots, std::uint32_t ring_bytes = 1u << 16)
+        : slot_count(slots), ring_bytes_(ring_bytes) {
+        if (slots == 0 || ring_bytes < pid_protocol::kMaxFrame || (ring_bytes & (ring_bytes - 1)) != 0) {
+            throw std::invalid_argument("Invalid ring geometry");
+        }
+        stride = sizeof(Slot) + 2 * (sizeof(Ring) + ring_bytes);
+        size = sizeof(Header) + slots * stride;
+        fd_ = static_cast<int>(syscall(SYS_memfd_create, "pid_rings", 0));
+        if (fd_ == -1 || ftruncate(fd_, static_cast<off_t>(size)) == -1) {
+            if (fd_ != -1) ::close(fd_);
+            throw std::runtime_error("memfd_create failed");
+        }
+        void* p = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd_, 0);
+        if (p == MAP_FAILED) {
+            ::close(fd_);
+            throw std::runtime_error("mmap failed");
+        }
+        base = static_cast<char*>(p);
+        Header* hdr = new (base) Header;
+        hdr->server_sleeping.store(0, std::memory_order_relaxed);
+        for (unsigned s = 0; s < slots; ++s) {
+            Slot* sl = new (slot_at(s)) Slot;
+            sl->state.store(kFree, std::memory_order_relaxed);
+            sl->client_pid.store(0, std::memory_order_relaxed);
+            sl->client_sleeping.store(0, std::memory_order_relaxed);
+            sl->stash.init();
+            (new (requests_at(s)) Ring)->init(ring_bytes);
+            (new (replies_at(s)) Ring)->init(ring_bytes);
+        }
+    }
+
+    ~Region() {
+        munmap(base, size);
+        ::close(fd_);
+    }
+
+    Region(const Region&) = delete;
+    Region& operator=(const Region&) = delete;
+
+    unsigned slots() const { return slot_count; }
+    int fd() const { return fd_; }
+    Word& server_sleeping() { return reinterpret_cast<Header*>(base)->server_sleeping; }
+    Slot& slot(unsigned s) { return *reinterpret_cast<Slot*>(slot_at(s)); }
+    Ring& requests(unsigned s) { return *reinterpret_cast<Ring*>(requests_at(s)); }
+    Ring& replies(unsigned s) { return *reinterpret_cast<Ring*>(replies_at(s)); }
+
+private:
+    struct Header {
+        alignas(64) Word server_sleeping;
+    };
+
+    char* slot_at(unsigned s) const { return base + sizeof(Header) + s * stride; }
+    char* requests_at(unsigned s) const { return slot_at(s) + sizeof(Slot); }
+    char* replies_at(unsigned s) const { return requests_at(s) + sizeof(Ring) + ring_bytes_; }
+
+    unsigned slot_count;
+    std::uint32_t ring_bytes_;
+    std::size_t stride;
+    std::size_t size;
+    int fd_;
+    char* base;
+};
+
+// Client end of one slot.
+class Client {
+public:
+    static constexpr int kSpin = 2000; // polls before sleeping
+
+    // Attaches to a free slot. Throws std::runtime_error if the slot is
+    // taken or the server has closed it.
+    Client(Region& region, unsigned slot) : r(region), s(slot) {
+        std::uint32_t expected = kFree;
+        if (!r.slot(s).state.compare_exchange_strong(expected, kAttaching, std::memory_order_acquire)) {
+            throw std::runtime_error("Ring slot is not free");
+        }
+        r.slot(s).client_pid.store(static_cast<std::int32_t>(getpid()), std::memory_order_relaxed);
+        r.slot(s).state.store(kAttached, std::memory_order_release);
+    }
+
+    // Pushes every frame in `frames` (built with pid_protocol::append),
+    // waiting for room if the request ring is full. Returns 1, or -1 if the
+    // buffer holds a truncated frame.
+    int send(const std::vector<char>& frames) {
+        std::size_t at = 0;
+        while (at < frames.size()) {
+            pid_protocol::Header h;
+            if (frames.size() - at < sizeof h) return -1;
+            std::memcpy(&h, &frames[at], sizeof h);
+            std::size_t n = pid_protocol::frame_size(h);
+            if (frames.size() - at < n) return -1;
+            while (!r.requests(s).push(&frames[at], n)) {
+                wake_if_sleeping(r.server_sleeping()); // let it drain
+                sched_yield();
+            }
+            at += n;
+        }
+        wake_if_sleeping(r.server_sleeping());
+        return 1;
+    }
+
+    // Takes a PID the server pushed ahead of time: no frame, no syscall.
+    // Returns -1 if none is waiting; ask with a kAlloc frame then. Taking
+    // the stash down to its low mark wakes the server to top it up.
+    int take_pushed() {
+        Stash& stash = r.slot(s).stash;
+        int pid = stash.take();
+        if (pid != -1 && stash.level() == stash.low.load(std::memory_order_relaxed)) {
+            wake_if_sleeping(r.server_sleeping());
+        }
+        return pid;
+    }
+
+    // Waits up to timeout_ms (-1: forever) for the next reply frame.
+    // Returns 1, 0 on timeout, or -1 if the ring is corrupt.
+    int receive(pid_protocol::Header& h, std::vector<int>& pids, int timeout_ms = -1) {
+        Ring& ring = r.replies(s);
+        for (int i = 0; i < kSpin; ++i) {
+            int got = ring.pop(h, pids);
+            if (got != 0) return got;
+        }
+        Word& sleeping = r.slot(s).client_sleeping;
+        sleeping.store(1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        int got = ring.pop(h, pids);
+        if (got == 0) {
+            futex_wait(sleeping, 1, timeout_ms);
+            got = ring.pop(h, pids);
+        }
+        sleeping.store(0, std::memory_order_relaxed);
+        return got;
+    }
+
+private:
+    Region& r;
+    unsigned s;
+};
+
+} // namespace pid_shm
+
+// Serves every slot of a region: a poller over the request rings that
+// sleeps on the region's futex only after a full pass finds nothing.
+// Slot s is owner first_owner + s in the manager.
+//
+// With enable_push(), the server also keeps each client's stash stocked
+// ahead of demand. It measures every client's rate (PIDs asked for plus
+// PIDs taken from the stash, as a moving average sampled each kSampleNs)
+// and tops the stash up to kPushHorizonNs worth of it whenever it falls to
+// half that. Pushes are capped per client and never take more than half
+// the free PIDs, so explicit requests can't be starved by speculation. A
+// stash nobody touched for the idle period is reclaimed and its PIDs freed;
+// so is the stash of a client that sends Done.
+//
+// A client can die without sending Done. The server opens a pidfd on each
+// attached client's process and, while any is watched, never sleeps longer
+// than kLivenessMs; when it wakes to nothing it polls the pidfds once. A
+// client that exited counts as Done, and everything its owner id holds is
+// released in one release_all().
+class PIDRingServer {
+public:
+    static constexpr int kSpin = 2000; // idle passes before sleeping
+    static constexpr std::int64_t kSampleNs = 1000000;
+    static constexpr std::int64_t kPushHorizonNs = 10000000;
+    static constexpr int kLivenessMs = 50;
+    static constexpr int kAttachMs = 10000;
+
+    PIDRingServer(PIDManager& manager, pid_shm::Region& region, std::uint32_t first_owner = 1)
+        : mgr(manager), r(region), base_owner(first_owner), backlog(region.slots()), demand(region.slots()),
+          pidfds(region.slots(), -1) {}
+
+    ~PIDRingServer() {
+        for (unsigned s = 0; s < r.slots(); ++s) unwatch(s);
+    }
+
+    PIDRingServer(const PIDRingServer&) = delete;
+    PIDRingServer& operator=(const PIDRingServer&) = delete;
+
+    // Turns on speculative push: at most `cap` PIDs stashed per client,
+    // reclaimed after idle_ms without a take or a request.
+    void enable_push(std::size_t cap = 256, int idle_ms = 100) {
+        push_cap = std::min<std::size_t>(cap, pid_shm::Stash::kSize);
+        idle_ns = static_cast<std::int64_t>(idle_ms) * 1000000;
+    }
+
+    // One pass over all rings; if nothing was waiting, spins and then
+    // sleeps up to timeout_ms. Returns the number of frames served.
+    std::size_t poll_once(int timeout_ms) {
+        std::size_t served = pass();
+        for (int i = 0; served == 0 && i < kSpin; ++i) served = pass();
+        if (served > 0 || timeout_ms == 0) return served;
+
+        // Stocked stashes need a pass after the idle period to be reclaimed.
+        if (push_cap > 0 && stocked() && (timeout_ms < 0 || timeout_ms > idle_ms())) timeout_ms = idle_ms();
+        // And a client that dies can't wake us.
+        if (watched > 0 && (timeout_ms < 0 || timeout_ms > kLivenessMs)) timeout_ms = kLivenessMs;
+        pid_shm::Word& sleeping = r.server_sleeping();
+        sleeping.store(1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        served = pass();
+        if (served == 0) {
+            pid_shm::futex_wait(sleeping, 1, timeout_ms);
+            served = pass();
+        }
+        sleeping.store(0, std::memory_order_relaxed);
+        if (served == 0 && watched > 0) check_clients();
+        return served;
+    }
+
+    // Serves until every slot has sent Done, been cut off as corrupt, or
+    // lost its client process. Slots nobody attached to within attach_ms
+    // (-1: wait forever) are closed.
+    void run(int attach_ms = kAttachMs) {
+        std::int64_t deadline = attach_ms < 0 ? -1 : now_ns() + static_cast<std::int64_t>(attach_ms) * 1000000;
+        while (!all_done()) {
+            poll_once(kLivenessMs);
+            if (deadline >= 0 && now_ns() >= deadline) {
+                close_unattached();
+                deadline = -1;
+            }
+        }
+    }
+
+    // Closes every slot no client has attached to yet. Returns how many.
+    std::size_t close_unattached() {
+        std::size_t closed = 0;
+        for (unsigned s = 0; s < r.slots(); ++s) {
+            std::uint32_t expected = pid_shm::kFree;
+            closed += r.slot(s).state.compare_exchange_strong(expected, pid_shm::kDoneState, std::memory_order_acq_rel);
+        }
+        return closed;
+    }
+
+    bool all_done() {
+        for (unsigned s = 0; s < r.slots(); ++s) {
+            if (r.slot(s).state.load(std::memory_order_acquire) != pid_shm::kDoneState) return false;
+        }
+        return true;
+    }
+
+    std::uint32_t owner_of(unsigned slot) const { return base_owner + slot; }
+    std::uint64_t frames_served() const { return frames; }
+    // PIDs pushed into stashes, and PIDs reclaimed from them, so far.
+    std::uint64_t pushed() const { return pushed_total; }
+    std::uint64_t reclaimed() const { return reclaimed_total; }
+    // Clients whose process exited before Done, and the PIDs freed for them.
+    std::size_t clients_lost() const { return lost_count; }
+    std::uint64_t released_on_exit() const { return exit_released; }
+    // A client's allocation rate estimate, in PIDs per second.
+    double rate(unsigned slot) const { return demand[slot].rate; }
+
+private:
+    // What the server knows about one client's appetite.
+    struct Demand {
+        double rate = 0;             // PIDs per second, moving average
+        std::uint64_t since = 0;     // PIDs asked for or taken since the last sample
+        std::uint32_t taken = 0;     // stash head at the last look
+        std::int64_t sampled_ns = 0;
+        std::int64_t active_ns = 0;  // last request or take
+    };
+
+    static std::int64_t now_ns() {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(
+                   std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    int idle_ms() const { return static_cast<int>(idle_ns / 1000000); }
+
+    bool stocked() {
+        for (unsigned s = 0; s < r.slots(); ++s) {
+            if (r.slot(s).stash.level() > 0) return true;
+        }
+        return false;
+    }
+
+    std::size_t pass() {
+        std::size_t served = 0;
+        pid_protocol::Header h{};
+        std::int64_t now = push_cap > 0 ? now_ns() : 0;
+        for (unsigned s = 0; s < r.slots(); ++s) {
+            pid_shm::Slot& slot = r.slot(s);
+            if (slot.state.load(std::memory_order_acquire) != pid_shm::kAttached) continue;
+            if (pidfds[s] == -1 && !watch(s)) continue;
+            // A client whose reply ring is full gets no more requests
+            // served until it reads, so it only holds itself up.
+            if (!flush(s)) continue;
+            pid_shm::Ring& in = r.requests(s);
+            std::vector<char>& out = backlog[s];
+            int got = 0;
+            while (out.empty() && (got = in.pop(h, pids)) == 1) {
+                ++served;
+                if (h.op == pid_protocol::kAlloc) {
+                    demand[s].since += h.count;
+                    demand[s].active_ns = now;
+                }
+                int rc = pid_protocol::serve(mgr, owner_of(s), h, pids, out);
+                flush(s);
+                if (rc != 1) {
+                    got = -1;
+                    break;
+                }
+            }
+            if (got == -1) {
+                slot.state.store(pid_shm::kDoneState, std::memory_order_release);
+                reclaim(s);
+                unwatch(s);
+            } else if (push_cap > 0) {
+                tend(s, now);
+            }
+        }
+        frames += served;
+        return served;
+    }
+
+    // Updates a client's rate estimate, then reclaims its stash if it has
+    // gone idle or tops it up if it is running low.
+    void tend(unsigned s, std::int64_t now) {
+        Demand& d = demand[s];
+        pid_shm::Stash& stash = r.slot(s).stash;
+        std::uint32_t taken = stash.taken();
+        if (taken != d.taken) {
+            d.since += taken - d.taken;
+            d.taken = taken;
+            d.active_ns = now;
+        }
+        if (d.sampled_ns == 0) d.sampled_ns = d.active_ns = now;
+        if (now - d.sampled_ns >= kSampleNs) {
+            double secs = static_cast<double>(now - d.sampled_ns) / 1e9;
+            d.rate = 0.75 * d.rate + 0.25 * static_cast<double>(d.since) / secs;
+            d.since = 0;
+            d.sampled_ns = now;
+        }
+        std::size_t level = stash.level();
+        if (now - d.active_ns >= idle_ns) {
+            if (level > 0) reclaim(s);
+            d.rate = 0;
+            d.since = 0;
+            return;
+        }
+        std::size_t want = std::min(push_cap, static_cast<std::size_t>(d.rate * kPushHorizonNs / 1e9));
+        if (want == 0 || level > want / 2) return;
+        std::size_t n = std::min(want - level, mgr.free_count() / 2);
+        if (n == 0) return;
+        grants.clear();
+        if (mgr.allocate_atomic(static_cast<int>(n), grants, owner_of(s)) != 1) return;
+        std::size_t fit = stash.push(grants.data(), grants.size());
+        for (std::size_t i = fit; i < grants.size(); ++i) mgr.release_pid(grants[i]);
+        stash.low.store(static_cast<std::uint32_t>(want / 2), std::memory_order_relaxed);
+        pushed_total += fit;
+    }
+
+    // Frees whatever is left in a client's stash. Reclaiming moves the
+    // stash head, which must not count as the client taking.
+    void reclaim(unsigned s) {
+        grants.clear();
+        r.slot(s).stash.reclaim(grants);
+        demand[s].taken = r.slot(s).stash.taken();
+        for (int pid : grants) mgr.release_pid(pid);
+        reclaimed_total += grants.size();
+    }
+
+    // Opens a pidfd on a newly attached client's process. Returns false if
+    // the process is already gone (the slot is then finished off). Without
+    // pidfd support (-2 marks the slot as tried) clients aren't watched.
+    bool watch(unsigned s) {
+        pid_t pid = r.slot(s).client_pid.load(std::memory_order_relaxed);
+        int fd = static_cast<int>(syscall(SYS_pidfd_open, pid, 0));
+        if (fd == -1 && errno == ESRCH) {
+            lost(s);
+            return false;
+        }
+        pidfds[s] = fd == -1 ? -2 : fd;
+        if (fd != -1) ++watched;
+        return true;
+    }
+
+    void unwatch(unsigned s) {
+        if (pidfds[s] >= 0) {
+            ::close(pidfds[s]);
+            --watched;
+        }
+        pidfds[s] = -1;
+    }
+
+    // Polls every watched pidfd once, without waiting.
+    void check_clients() {
+        std::vector<pollfd> fds;
+        std::vector<unsigned> of;
+        for (unsigned s = 0; s < r.slots(); ++s) {
+            if (pidfds[s] < 0) continue;
+            fds.push_back(pollfd{pidfds[s], POLLIN, 0});
+            of.push_back(s);
+        }
+        if (poll(fds.data(), fds.size(), 0) <= 0) return;
+        for (std::size_t i = 0; i < fds.size(); ++i) {
+            if (fds[i].revents != 0) lost(of[i]);
+        }
+    }
+
+    // The client's process exited without Done: close its slot, drop its
+    // unsent replies and free everything it held.
+    void lost(unsigned s) {
+        r.slot(s).state.store(pid_shm::kDoneState, std::memory_order_release);
+        backlog[s].clear();
+        reclaim(s);
+        exit_released += mgr.release_all(owner_of(s));
+        ++lost_count;
+        unwatch(s);
+    }
+
+    // Moves a slot's backlogged reply frames into its reply ring.
+    // Returns true once the backlog is empty.
+    bool flush(unsigned s) {
+        std::vector<char>& out = backlog[s];
+        if (out.empty()) return true;
+        pid_shm::Ring& ring = r.replies(s);
+        std::size_t at = 0;
+        while (at < out.size()) {
+            pid_protocol::Header h;
+            std::memcpy(&h, &out[at], sizeof h);
+            std::size_t n = pid_protocol::frame_size(h);
+            if (!ring.push(&out[at], n)) break;
+            at += n;
+        }
+        if (at > 0) pid_shm::wake_if_sleeping(r.slot(s).client_sleeping);
+        out.erase(out.begin(), out.begin() + static_cast<std::ptrdiff_t>(at));
+        return out.empty();
+    }
+
+    PIDManager& mgr;
+    pid_shm::Region& r;
+    std::uint32_t base_owner;
+    std::uint64_t frames = 0;
+    std::vector<std::vector<char>> backlog; // per slot: replies that didn't fit yet
+    std::vector<int> pids;
+    std::vector<Demand> demand;              // per slot
+    std::vector<int> grants;                 // scratch for pushes and reclaims
+    std::size_t push_cap = 0;                // 0: push is off
+    std::int64_t idle_ns = 0;
+    std::uint64_t pushed_total = 0;
+    std::uint64_t reclaimed_total = 0;
+    std::vector<int> pidfds;                 // per slot: -1 unwatched, -2 can't watch
+    std::size_t watched = 0;
+    std::size_t lost_count = 0;
+    std::uint64_t exit_released = 0;
+};
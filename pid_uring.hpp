@@ -0,0 +1,678 @@
+#pragma once
+#include <algorithm>
+#include <vector>
+#include <string>
+#include <stdexcept>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <cerrno>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <sys/un.h>
+#include <linux/io_uring.h>
+#include "pid_manager.hpp"
+#include "pid_protocol.hpp"
+
+// io_uring backend for the PID server: the same frames and the same
+// per-client rules as PIDServer, with the I/O done by the kernel.
+//
+// Every client socket has one multishot receive armed. It draws its
+// buffers from a provided-buffer ring, so a single SQE keeps delivering
+// data, one CQE per datagram (or per stream chunk), until it is cancelled.
+// Replies are copied into an arena that stays put while the kernel reads
+// it and sent with IORING_OP_SEND and MSG_NOSIGNAL: a client that hangs up
+// with replies pending fails its sends with EPIPE instead of raising
+// SIGPIPE in the server. (WRITE_FIXED could use a registered arena, but a
+// write has no MSG_NOSIGNAL, and SEND only takes registered buffers on
+// newer kernels.) On a SOCK_SEQPACKET client each frame is its own send
+// and a reply burst is one IOSQE_IO_LINK chain, which keeps the datagrams
+// in order. The listener has a multishot accept.
+//
+// One io_uring_enter submits every queued reply and cancel and then waits;
+// the CQEs it returns (requests from any number of clients) are all served
+// before the next one, so a busy server makes a syscall per round, not per
+// client. A client whose queued replies pass kMaxPending has its receive
+// cancelled until it catches up, so it only blocks itself. Each client is
+// its own owner id in the manager, numbered from `first_owner`.
+//
+// A client's process can be watched through a pidfd (watch_process, or
+// watch_peers for accepted sockets): a one-shot POLL_ADD on it completes
+// in the same ring when the process exits, and the client is dropped and
+// everything its owner id holds freed in one release_all().
+//
+// Sockets only: pipes would need a multishot read, which this kernel
+// header doesn't define.
+class PIDUringServer {
+public:
+    static constexpr std::size_t kMaxPending = 1 << 20;
+    static constexpr unsigned kRecvBuffers = 64;        // provided buffers, a power of two
+    static constexpr std::size_t kRecvBufferSize = 8192; // holds any frame
+    static constexpr std::size_t kChunk = 16384;         // one send chain's share of the arena
+    static constexpr unsigned kChunks = 64;              // 1 MiB of reply buffers
+    static constexpr unsigned kMaxChain = 16;            // datagrams per linked chain
+
+    explicit PIDUringServer(PIDManager& manager, unsigned entries = 256, std::uint32_t first_owner = 1)
+        : mgr(manager), first_id(first_owner) {
+        if (entries < 2 * kMaxChain) entries = 2 * kMaxChain;
+        io_uring_params p{};
+        p.flags = IORING_SETUP_CQSIZE;
+        p.cq_entries = entries * 4; // multishot ops post several CQEs per SQE
+        ring_fd = static_cast<int>(syscall(SYS_io_uring_setup, entries, &p));
+        if (ring_fd == -1) throw std::runtime_error("io_uring_setup failed");
+        if (!(p.features & IORING_FEAT_EXT_ARG) || map_rings(p) == -1 || setup_buffers() == -1) {
+            unmap_rings();
+            ::close(ring_fd);
+            throw std::runtime_error("io_uring lacks multishot receive support");
+        }
+    }
+
+    ~PIDUringServer() {
+        // Cancel everything still armed before the buffers it points at go.
+        io_uring_sqe* s = sqe();
+        if (s != nullptr) {
+            s->opcode = IORING_OP_ASYNC_CANCEL;
+            s->fd = -1;
+            s->cancel_flags = IORING_ASYNC_CANCEL_ANY | IORING_ASYNC_CANCEL_ALL;
+            s->user_data = tag(kCancel, 0);
+            enter(1, 1000);
+        }
+        if (listen_fd != -1) {
+            ::close(listen_fd);
+            ::unlink(listen_path.c_str());
+        }
+        for (Client& c : clients) {
+            if (c.open) ::close(c.fd);
+            if (c.pidfd != -1) ::close(c.pidfd);
+        }
+        unmap_rings();
+        ::close(ring_fd);
+        if (buf_ring != nullptr) munmap(buf_ring, buf_ring_bytes);
+    }
+
+    PIDUringServer(const PIDUringServer&) = delete;
+    PIDUringServer& operator=(const PIDUringServer&) = delete;
+
+    // Takes ownership of a connected AF_UNIX stream or SOCK_SEQPACKET
+    // socket. Returns the client's id, which is also its owner id in the
+    // manager, or -1.
+    int add_client(int fd) {
+        int type = 0;
+        socklen_t len = sizeof type;
+        if (getsockopt(fd, SOL_SOCKET, SO_TYPE, &type, &len) == -1 || (type != SOCK_STREAM && type != SOCK_SEQPACKET)) {
+            return -1;
+        }
+        // Blocking, so the kernel waits for readiness instead of failing
+        // the request with EAGAIN.
+        int flags = fcntl(fd, F_GETFL);
+        if (flags == -1 || fcntl(fd, F_SETFL, flags & ~O_NONBLOCK) == -1) return -1;
+        clients.emplace_back();
+        Client& c = clients.back();
+        c.fd = fd;
+        c.id = first_id + static_cast<std::uint32_t>(clients.size() - 1);
+        c.datagram = type == SOCK_SEQPACKET;
+        c.open = true;
+        ++open_count;
+        arm_recv(c);
+        return static_cast<int>(c.id);
+    }
+
+    // Watches process `pid` on behalf of client `id`: when it exits, the
+    // client's connection is dropped and every PID it owns is released
+    // (metadata must be on). Returns 1, or -1 (unknown client, already
+    // watched, or no such process).
+    int watch_process(int id, pid_t pid) {
+        if (id < static_cast<int>(first_id) || static_cast<std::size_t>(id) - first_id >= clients.size()) return -1;
+        if (client(static_cast<std::uint32_t>(id)).pidfd != -1) return -1;
+        return watch_pidfd(client(static_cast<std::uint32_t>(id)), static_cast<int>(syscall(SYS_pidfd_open, pid, 0)));
+    }
+
+    // Watches the process behind every socket client accepted from now on
+    // (see pid_protocol::peer_pidfd).
+    void watch_peers(bool on) { watch_accepted = on; }
+
+    // Listens for SOCK_SEQPACKET clients on `path`, replacing any stale
+    // socket file there. Returns 1, or -1.
+    int listen_unix(const char* path) {
+        sockaddr_un addr{};
+        if (listen_fd != -1 || std::strlen(path) >= sizeof addr.sun_path) return -1;
+        int fd = ::socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+        if (fd == -1) return -1;
+        addr.sun_family = AF_UNIX;
+        std::strcpy(addr.sun_path, path);
+        ::unlink(path);
+        if (::bind(fd, reinterpret_cast<const sockaddr*>(&addr), sizeof addr) == -1 || ::listen(fd, SOMAXCONN) == -1) {
+            ::close(fd);
+            return -1;
+        }
+        listen_fd = fd;
+        listen_path = path;
+        arm_accept();
+        return 1;
+    }
+
+    // Stops accepting and removes the socket file. Connected clients stay.
+    void close_listener() {
+        if (listen_fd == -1) return;
+        cancel(tag(kAccept, 0));
+        enter(0, 0);
+        ::close(listen_fd);
+        ::unlink(listen_path.c_str());
+        listen_fd = -1;
+    }
+
+    // Submits whatever is queued, waits up to timeout_ms (-1: forever) for
+    // completions, serves all of them and submits the replies. Returns the
+    // number of completions handled, or -1 on error.
+    int poll_once(int timeout_ms) {
+        if (enter(timeout_ms == 0 ? 0 : 1, timeout_ms) == -1) return -1;
+        int n = reap();
+        return enter(0, 0) == -1 ? -1 : n;
+    }
+
+    // Serves until every client has disconnected. Each round is a single
+    // io_uring_enter: it submits the last round's replies and waits for the
+    // next requests. Returns 1, or -1 on error.
+    int run() {
+        while (open_count > 0) {
+            if (enter(1, -1) == -1) return -1;
+            reap();
+        }
+        return 1;
+    }
+
+    std::size_t client_count() const { return open_count; }
+    // Every client ever added or accepted, connected or not.
+    std::size_t clients_seen() const { return clients.size(); }
+    std::uint64_t frames_served() const { return frames; }
+    // Client processes still being watched.
+    std::size_t watching() const { return watched; }
+    // PIDs freed because their client's process exited.
+    std::uint64_t reclaimed() const { return reclaimed_total; }
+    // io_uring_enter calls made so far.
+    std::uint64_t enters() const { return enter_calls; }
+
+private:
+    enum Kind : std::uint64_t { kAccept = 1, kRecv = 2, kWrite = 3, kCancel = 4, kExit = 5 };
+
+    struct Client {
+        int fd = -1;
+        int pidfd = -1;              // the client's process, if watched
+        bool exit_retried = false;   // its pidfd poll failed once and was re-armed
+        std::uint32_t id = 0;
+        bool open = false;
+        bool datagram = false;       // SOCK_SEQPACKET: one frame per datagram
+        bool closing = false;        // Done, EOF or an error: finish writing, then close
+        bool recv_armed = false;     // a multishot receive is live
+        bool cancelling = false;     // and a cancel for it is on its way
+        bool waiting = false;        // queued for an arena chunk
+        bool write_failed = false;
+        unsigned writes = 0;         // write SQEs in flight
+        int chunk = -1;              // arena chunk those writes read from
+        std::size_t chunk_len = 0;
+        std::size_t chunk_done = 0;  // bytes of the chunk written so far
+        pid_protocol::Decoder requests;
+        std::vector<char> replies;
+        std::size_t sent = 0;        // bytes of replies already written
+        std::size_t pending() const { return replies.size() - sent; }
+    };
+
+    static std::uint64_t tag(Kind kind, std::uint32_t id) { return static_cast<std::uint64_t>(kind) << 56 | id; }
+
+    Client& client(std::uint32_t id) { return clients[id - first_id]; }
+
+    int map_rings(const io_uring_params& p) {
+        sq_bytes = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+        cq_bytes = p.cq_off.cqes + p.cq_entries * sizeof(io_uring_cqe);
+        if (p.features & IORING_FEAT_SINGLE_MMAP) sq_bytes = cq_bytes = std::max(sq_bytes, cq_bytes);
+        sq_ptr = mmap(nullptr, sq_bytes, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_fd, IORING_OFF_SQ_RING);
+        if (sq_ptr == MAP_FAILED) return sq_ptr = nullptr, -1;
+        if (p.features & IORING_FEAT_SINGLE_MMAP) {
+            cq_ptr = sq_ptr;
+        } else {
+            cq_ptr = mmap(nullptr, cq_bytes, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_fd, IORING_OFF_CQ_RING);
+            if (cq_ptr == MAP_FAILED) return cq_ptr = nullptr, -1;
+        }
+        sqes_bytes = p.sq_entries * sizeof(io_uring_sqe);
+        void* s = mmap(nullptr, sqes_bytes, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_fd, IORING_OFF_SQES);
+        if (s == MAP_FAILED) return -1;
+        sqes = static_cast<io_uring_sqe*>(s);
+        char* sq = static_cast<char*>(sq_ptr);
+        char* cq = static_cast<char*>(cq_ptr);
+        sq_head = reinterpret_cast<unsigned*>(sq + p.sq_off.head);
+        sq_tail = reinterpret_cast<unsigned*>(sq + p.sq_off.tail);
+        sq_array = reinterpret_cast<unsigned*>(sq + p.sq_off.array);
+        sq_mask = *reinterpret_cast<unsigned*>(sq + p.sq_off.ring_mask);
+        sq_entries = p.sq_entries;
+        cq_head = reinterpret_cast<unsigned*>(cq + p.cq_off.head);
+        cq_tail = reinterpret_cast<unsigned*>(cq + p.cq_off.tail);
+        cq_mask = *reinterpret_cast<unsigned*>(cq + p.cq_off.ring_mask);
+        cqes = reinterpret_cast<io_uring_cqe*>(cq + p.cq_off.cqes);
+        sq_local = *sq_tail;
+        return 0;
+    }
+
+    void unmap_rings() {
+        if (sqes != nullptr) munmap(sqes, sqes_bytes);
+        if (cq_ptr != nullptr && cq_ptr != sq_ptr) munmap(cq_ptr, cq_bytes);
+        if (sq_ptr != nullptr) munmap(sq_ptr, sq_bytes);
+        sqes = nullptr;
+        sq_ptr = cq_ptr = nullptr;
+    }
+
+    // Registers the receive buffer ring and sets up the reply arena.
+    int setup_buffers() {
+        recv_data.resize(kRecvBuffers * kRecvBufferSize);
+        arena.resize(kChunks * kChunk);
+        buf_ring_bytes = kRecvBuffers * sizeof(io_uring_buf);
+        void* r = mmap(nullptr, buf_ring_bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (r == MAP_FAILED) return -1;
+        buf_ring = static_cast<io_uring_buf_ring*>(r);
+        io_uring_buf_reg reg{};
+        reg.ring_addr = reinterpret_cast<std::uint64_t>(buf_ring);
+        reg.ring_entries = kRecvBuffers;
+        reg.bgid = kBufferGroup;
+        if (syscall(SYS_io_uring_register, ring_fd, IORING_REGISTER_PBUF_RING, &reg, 1) == -1) return -1;
+        for (unsigned b = 0; b < kRecvBuffers; ++b) recycle(static_cast<std::uint16_t>(b));
+        for (unsigned i = kChunks; i > 0; --i) free_chunks.push_back(static_cast<int>(i - 1));
+        return 0;
+    }
+
+    // Hands a receive buffer back to the kernel. Entry 0's last field is
+    // the ring tail, so entries are filled field by field. (In C++ the
+    // header's flexible `bufs` member lands past offset 0, so index the
+    // entries directly.)
+    void recycle(std::uint16_t bid) {
+        io_uring_buf& b = reinterpret_cast<io_uring_buf*>(buf_ring)[buf_tail & (kRecvBuffers - 1)];
+        b.addr = reinterpret_cast<std::uint64_t>(&recv_data[bid * kRecvBufferSize]);
+        b.len = static_cast<std::uint32_t>(kRecvBufferSize);
+        b.bid = bid;
+        ++buf_tail;
+        __atomic_store_n(&buf_ring->tail, buf_tail, __ATOMIC_RELEASE);
+    }
+
+    // Next free SQE, zeroed; submits the queue first if it is full.
+    io_uring_sqe* sqe() {
+        if (sq_local - __atomic_load_n(sq_head, __ATOMIC_ACQUIRE) == sq_entries && enter(0, 0) == -1) return nullptr;
+        if (sq_local - __atomic_load_n(sq_head, __ATOMIC_ACQUIRE) == sq_entries) return nullptr;
+        unsigned idx = sq_local & sq_mask;
+        io_uring_sqe* s = &sqes[idx];
+        std::memset(s, 0, sizeof *s);
+        sq_array[idx] = idx;
+        ++sq_local;
+        return s;
+    }
+
+    // Makes room for `n` SQEs in a row, so a linked chain isn't split
+    // across two submissions.
+    bool reserve(unsigned n) {
+        if (sq_entries - (sq_local - __atomic_load_n(sq_head, __ATOMIC_ACQUIRE)) >= n) return true;
+        return enter(0, 0) == 0 && sq_entries - (sq_local - __atomic_load_n(sq_head, __ATOMIC_ACQUIRE)) >= n;
+    }
+
+    // Submits every queued SQE and, if wait_nr > 0, waits for that many
+    // completions or timeout_ms (-1: no limit). Returns 0, or -1.
+    int enter(unsigned wait_nr, int timeout_ms) {
+        __atomic_store_n(sq_tail, sq_local, __ATOMIC_RELEASE);
+        unsigned to_submit = sq_local - __atomic_load_n(sq_head, __ATOMIC_ACQUIRE);
+        if (to_submit == 0 && wait_nr == 0) return 0;
+        unsigned flags = 0;
+        io_uring_getevents_arg arg{};
+        __kernel_timespec ts{};
+        if (wait_nr > 0) {
+            flags |= IORING_ENTER_GETEVENTS | IORING_ENTER_EXT_ARG;
+            if (timeout_ms >= 0) {
+                ts.tv_sec = timeout_ms / 1000;
+                ts.tv_nsec = static_cast<long long>(timeout_ms % 1000) * 1000000LL;
+                arg.ts = reinterpret_cast<std::uint64_t>(&ts);
+            }
+        }
+        ++enter_calls;
+        long r = syscall(SYS_io_uring_enter, ring_fd, to_submit, wait_nr, flags,
+                         flags & IORING_ENTER_EXT_ARG ? &arg : nullptr, sizeof arg);
+        if (r >= 0) return 0;
+        // A timeout, a signal, or a full completion queue we are about to drain.
+        return errno == ETIME || errno == EINTR || errno == EBUSY ? 0 : -1;
+    }
+
+    // Handles every completion posted so far. Returns how many.
+    int reap() {
+        int n = 0;
+        unsigned head = *cq_head;
+        while (head != __atomic_load_n(cq_tail, __ATOMIC_ACQUIRE)) {
+            io_uring_cqe cqe = cqes[head & cq_mask];
+            __atomic_store_n(cq_head, ++head, __ATOMIC_RELEASE);
+            complete(cqe);
+            ++n;
+        }
+        return n;
+    }
+
+    void complete(const io_uring_cqe& cqe) {
+        Kind kind = static_cast<Kind>(cqe.user_data >> 56);
+        std::uint32_t id = static_cast<std::uint32_t>(cqe.user_data);
+        if (kind == kAccept) {
+            if (cqe.res >= 0) {
+                int cid = add_client(cqe.res);
+                if (cid == -1) {
+                    ::close(cqe.res);
+                } else if (watch_accepted) {
+                    watch_pidfd(client(static_cast<std::uint32_t>(cid)), pid_protocol::peer_pidfd(cqe.res));
+                }
+            }
+            if (!(cqe.flags & IORING_CQE_F_MORE) && listen_fd != -1) arm_accept();
+            return;
+        }
+        if (kind == kCancel) return;
+        Client& c = client(id);
+        if (kind == kRecv) {
+            on_recv(c, cqe);
+        } else if (kind == kExit) {
+            on_exit(c, cqe.res);
+        } else {
+            on_write(c, cqe.res);
+        }
+        settle(c);
+    }
+
+    void arm_accept() {
+        io_uring_sqe* s = sqe();
+        if (s == nullptr) return;
+        s->opcode = IORING_OP_ACCEPT;
+        s->fd = listen_fd;
+        s->ioprio = IORING_ACCEPT_MULTISHOT;
+        s->accept_flags = SOCK_CLOEXEC;
+        s->user_data = tag(kAccept, 0);
+    }
+
+    void arm_recv(Client& c) {
+        io_uring_sqe* s = sqe();
+        if (s == nullptr) return; // settle() tries again next round
+        s->opcode = IORING_OP_RECV;
+        s->fd = c.fd;
+        s->ioprio = IORING_RECV_MULTISHOT;
+        s->flags = IOSQE_BUFFER_SELECT;
+        s->buf_group = kBufferGroup;
+        s->user_data = tag(kRecv, c.id);
+        c.recv_armed = true;
+    }
+
+    // Watches pidfd `fd` (taken over, -1 allowed) for client `c`.
+    int watch_pidfd(Client& c, int fd) {
+        if (fd == -1) return -1;
+        c.pidfd = fd;
+        if (!arm_exit(c)) {
+            ::close(fd);
+            c.pidfd = -1;
+            return -1;
+        }
+        ++watched;
+        return 1;
+    }
+
+    // Arms a one-shot poll on the client's pidfd; it completes once the
+    // process has exited.
+    bool arm_exit(Client& c) {
+        io_uring_sqe* s = sqe();
+        if (s == nullptr) return false;
+        s->opcode = IORING_OP_POLL_ADD;
+        s->fd = c.pidfd;
+        s->poll32_events = POLLIN;
+        s->user_data = tag(kExit, c.id);
+        return true;
+    }
+
+    // The client's process is gone (res: the poll's result): drop the
+    // connection, unserved frames, queued replies and all, and free whatever
+    // it still owned. settle() closes the socket once nothing is in flight.
+    // The poll stays armed after a clean disconnect, so a client that sent
+    // Done without releasing everything is cleaned up here too. A failed
+    // poll says nothing about the process and is armed again, once; a
+    // client that can't be watched after that is dropped as if it had
+    // exited rather than left holding PIDs no one will reclaim.
+    void on_exit(Client& c, int res) {
+        if (res < 0 && !c.exit_retried && arm_exit(c)) {
+            c.exit_retried = true;
+            return;
+        }
+        ::close(c.pidfd);
+        c.pidfd = -1;
+        --watched;
+        if (c.open) {
+            c.closing = true;
+            c.write_failed = true;
+            c.requests = pid_protocol::Decoder();
+        }
+        reclaimed_total += mgr.release_all(c.id);
+    }
+
+    void cancel(std::uint64_t target) {
+        io_uring_sqe* s = sqe();
+        if (s == nullptr) return;
+        s->opcode = IORING_OP_ASYNC_CANCEL;
+        s->fd = -1;
+        s->addr = target;
+        s->user_data = tag(kCancel, 0);
+    }
+
+    void on_recv(Client& c, const io_uring_cqe& cqe) {
+        if (!(cqe.flags & IORING_CQE_F_MORE)) {
+            c.recv_armed = false;
+            c.cancelling = false;
+        }
+        if (cqe.flags & IORING_CQE_F_BUFFER) {
+            std::uint16_t bid = static_cast<std::uint16_t>(cqe.flags >> IORING_CQE_BUFFER_SHIFT);
+            if (cqe.res > 0 && !c.closing) deliver(c, &recv_data[bid * kRecvBufferSize], static_cast<std::size_t>(cqe.res));
+            recycle(bid);
+            return;
+        }
+        // Out of buffers or cancelled: settle() re-arms. Anything else ends the client.
+        if (cqe.res == 0 || (cqe.res < 0 && cqe.res != -ENOBUFS && cqe.res != -ECANCELED)) c.closing = true;
+    }
+
+    void deliver(Client& c, const char* data, std::size_t n) {
+        if (!c.datagram) {
+            c.requests.feed(data, n);
+            serve_buffered(c);
+            return;
+        }
+        pid_protocol::Header h{};
+        if (pid_protocol::parse_frame(data, n, h, pids) != 1) {
+            c.closing = true;
+            return;
+        }
+        serve_one(c, h);
+    }
+
+    void serve_buffered(Client& c) {
+        pid_protocol::Header h{};
+        int r = 0;
+        while (c.pending() < kMaxPending && (r = c.requests.next(h, pids)) == 1) {
+            if (!serve_one(c, h)) return;
+        }
+        if (r == -1) {
+            c.closing = true;
+            c.requests = pid_protocol::Decoder();
+        }
+    }
+
+    // Serves one decoded frame (payload in `pids`). Returns false, and
+    // starts closing the connection, on Done or a frame a client may not send.
+    bool serve_one(Client& c, const pid_protocol::Header& h) {
+        ++frames;
+        if (pid_protocol::serve(mgr, c.id, h, pids, c.replies) == 1) return true;
+        c.closing = true;
+        c.requests = pid_protocol::Decoder(); // nothing after Done is served
+        return false;
+    }
+
+    // Starts writing queued replies unless a write is already in flight.
+    // The bytes go into a free arena chunk; a client finding none waits
+    // for one to come back.
+    void flush(Client& c) {
+        if (c.writes > 0 || c.pending() == 0 || c.write_failed) return;
+        if (free_chunks.empty()) {
+            if (!c.waiting) waiting.push_back(c.id);
+            c.waiting = true;
+            return;
+        }
+        std::size_t n = std::min(c.pending(), kChunk);
+        if (c.datagram) { // whole frames only, at most kMaxChain of them
+            n = 0;
+            for (unsigned k = 0; k < kMaxChain && c.sent + n < c.replies.size(); ++k) {
+                std::size_t size = frame_at(c.replies.data() + c.sent + n);
+                if (n + size > kChunk) break;
+                n += size;
+            }
+        }
+        c.chunk = free_chunks.back();
+        free_chunks.pop_back();
+        std::memcpy(chunk_data(c.chunk), &c.replies[c.sent], n);
+        c.chunk_len = n;
+        c.chunk_done = 0;
+        submit_writes(c);
+    }
+
+    static std::size_t frame_at(const char* p) {
+        pid_protocol::Header h;
+        std::memcpy(&h, p, sizeof h);
+        return pid_protocol::frame_size(h);
+    }
+
+    char* chunk_data(int chunk) { return &arena[static_cast<std::size_t>(chunk) * kChunk]; }
+
+    // Queues sends for the unwritten part of the client's chunk: one send
+    // on a stream, a linked chain of one send per frame on a datagram socket.
+    void submit_writes(Client& c) {
+        const char* base = chunk_data(c.chunk);
+        unsigned n = 1;
+        if (c.datagram) {
+            n = 0;
+            for (std::size_t at = c.chunk_done; at < c.chunk_len; at += frame_at(base + at)) ++n;
+        }
+        if (!reserve(n)) {
+            c.write_failed = true;
+            release_chunk(c);
+            return;
+        }
+        for (std::size_t at = c.chunk_done; at < c.chunk_len;) {
+            std::size_t len = c.datagram ? frame_at(base + at) : c.chunk_len - at;
+            io_uring_sqe* s = sqe();
+            s->opcode = IORING_OP_SEND;
+            s->fd = c.fd;
+            s->addr = reinterpret_cast<std::uint64_t>(base + at);
+            s->len = static_cast<std::uint32_t>(len);
+            s->msg_flags = MSG_NOSIGNAL;
+            at += len;
+            if (at < c.chunk_len) s->flags = IOSQE_IO_LINK;
+            s->user_data = tag(kWrite, c.id);
+            ++c.writes;
+        }
+    }
+
+    // One write finished. When the whole chain is back, either resubmit
+    // what a short write left over or move on to the next chunk.
+    void on_write(Client& c, int res) {
+        --c.writes;
+        if (res <= 0) {
+            c.write_failed = true; // the client is gone (the rest of a chain reports -ECANCELED)
+        } else {
+            c.chunk_done += static_cast<std::size_t>(res);
+        }
+        if (c.writes > 0) return;
+        if (!c.write_failed && c.chunk_done < c.chunk_len) {
+            submit_writes(c);
+            return;
+        }
+        if (!c.write_failed) c.sent += c.chunk_len;
+        if (c.pending() == 0) {
+            c.replies.clear();
+            c.sent = 0;
+        }
+        release_chunk(c);
+    }
+
+    void release_chunk(Client& c) {
+        free_chunks.push_back(c.chunk);
+        c.chunk = -1;
+        while (!free_chunks.empty() && !waiting.empty()) {
+            Client& next = client(waiting.front());
+            waiting.erase(waiting.begin());
+            next.waiting = false;
+            if (next.open) flush(next);
+        }
+    }
+
+    // After a completion: serve frames left waiting for reply space, start
+    // writing, and keep the receive armed only while replies fit. A closing
+    // client is closed once nothing of its is in flight.
+    void settle(Client& c) {
+        if (!c.open) return;
+        if (c.requests.buffered() > 0 && c.pending() < kMaxPending) serve_buffered(c);
+        if (c.write_failed) {
+            c.closing = true;
+            c.replies.clear();
+            c.sent = 0;
+        }
+        flush(c);
+        if (c.closing || c.pending() >= kMaxPending) {
+            if (c.recv_armed && !c.cancelling) {
+                cancel(tag(kRecv, c.id));
+                c.cancelling = true;
+            }
+        } else if (!c.recv_armed && c.pending() < kMaxPending / 2) {
+            arm_recv(c);
+        }
+        if (c.closing && !c.recv_armed && c.writes == 0 && (c.pending() == 0 || c.write_failed)) finish(c);
+    }
+
+    void finish(Client& c) {
+        ::close(c.fd);
+        c.open = false;
+        c.requests = pid_protocol::Decoder();
+        std::vector<char>().swap(c.replies);
+        c.sent = 0;
+        --open_count;
+    }
+
+    static constexpr std::uint16_t kBufferGroup = 0;
+
+    PIDManager& mgr;
+    std::uint32_t first_id;
+    int ring_fd = -1;
+    void* sq_ptr = nullptr;
+    void* cq_ptr = nullptr;
+    std::size_t sq_bytes = 0, cq_bytes = 0, sqes_bytes = 0;
+    io_uring_sqe* sqes = nullptr;
+    unsigned* sq_head = nullptr;
+    unsigned* sq_tail = nullptr;
+    unsigned* sq_array = nullptr;
+    unsigned sq_mask = 0, sq_entries = 0;
+    unsigned sq_local = 0;          // our tail, published on enter()
+    unsigned* cq_head = nullptr;
+    unsigned* cq_tail = nullptr;
+    unsigned cq_mask = 0;
+    io_uring_cqe* cqes = nullptr;
+    io_uring_buf_ring* buf_ring = nullptr;
+    std::size_t buf_ring_bytes = 0;
+    std::uint16_t buf_tail = 0;
+    std::vector<char> recv_data;    // kRecvBuffers provided buffers
+    std::vector<char> arena;        // kChunks reply chunks
+    std::vector<int> free_chunks;
+    std::vector<std::uint32_t> waiting; // client ids queued for a chunk
+    std::vector<Client> clients;    // client id - first_id -> connection
+    std::size_t open_count = 0;
+    bool watch_accepted = false;
+    std::size_t watched = 0;
+    std::uint64_t reclaimed_total = 0;
+    std::uint64_t frames = 0;
+    std::uint64_t enter_calls = 0;
+    std::vector<int> pids;          // scratch for decoded payloads
+    int listen_fd = -1;
+    std::string listen_path;
+};
@@ -0,0 +1,113 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define PID_SIMD_X86 1
+#endif
+
+// Word-scan kernels for the packed bitmap.
+//
+// find_word(words, from, to, skip) returns the first index in [from, to)
+// whose word differs from `skip`, or `to` if there is none. With
+// skip = ~0 that is "first word with a free bit"; with skip = 0 it is
+// "first word with an allocated bit". The SSE2/AVX2/AVX-512 kernels compare
+// 256/512/512 bits per iteration and only fall back to scalar code to
+// pinpoint the word inside the block that differed.
+//
+// The kernel is picked once at runtime from cpuid (via __builtin_cpu_supports),
+// so the same binary runs everywhere; other architectures use the scalar one.
+namespace simd_scan {
+
+using FindWordFn = std::size_t (*)(const std::uint64_t* words, std::size_t from,
+                                   std::size_t to, std::uint64_t skip);
+
+inline std::size_t find_word_scalar(const std::uint64_t* words, std::size_t from,
+                                    std::size_t to, std::uint64_t skip) {
+    for (std::size_t w = from; w < to; ++w) {
+        if (words[w] != skip) return w;
+    }
+    return to;
+}
+
+#ifdef PID_SIMD_X86
+__attribute__((target("sse2")))
+inline std::size_t find_word_sse2(const std::uint64_t* words, std::size_t from,
+                                  std::size_t to, std::uint64_t skip) {
+    const __m128i pattern = _mm_set1_epi64x(static_cast<long long>(skip));
+    std::size_t w = from;
+    for (; w + 4 <= to; w += 4) {
+        __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(words + w));
+        __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(words + w + 2));
+        __m128i eq = _mm_and_si128(_mm_cmpeq_epi32(a, pattern), _mm_cmpeq_epi32(b, pattern));
+        if (_mm_movemask_epi8(eq) != 0xFFFF) break;
+    }
+    return find_word_scalar(words, w, to, skip);
+}
+
+__attribute__((target("avx2")))
+inline std::size_t find_word_avx2(const std::uint64_t* words, std::size_t from,
+                                  std::size_t to, std::uint64_t skip) {
+    const __m256i pattern = _mm256_set1_epi64x(static_cast<long long>(skip));
+    std::size_t w = from;
+    for (; w + 8 <= to; w += 8) {
+        __m256i a = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(words + w));
+        __m256i b = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(words + w + 4));
+        __m256i eq = _mm256_and_si256(_mm256_cmpeq_epi64(a, pattern), _mm256_cmpeq_epi64(b, pattern));
+        if (static_cast<unsigned>(_mm256_movemask_epi8(eq)) != 0xFFFFFFFFu) break;
+    }
+    return find_word_scalar(words, w, to, skip);
+}
+
+__attribute__((target("avx512f")))
+inline std::size_t find_word_avx512(const std::uint64_t* words, std::size_t from,
+                                    std::size_t to, std::uint64_t skip) {
+    const __m512i pattern = _mm512_set1_epi64(static_cast<long long>(skip));
+    std::size_t w = from;
+    for (; w + 8 <= to; w += 8) {
+        __m512i a = _mm512_loadu_si512(static_cast<const void*>(words + w));
+        __mmask8 ne = _mm512_cmpneq_epi64_mask(a, pattern);
+        if (ne != 0) return w + static_cast<std::size_t>(__builtin_ctz(ne));
+    }
+    return find_word_scalar(words, w, to, skip);
+}
+#endif
+
+struct Kernel {
+    const char* name;
+    FindWordFn fn;
+    bool supported;
+};
+
+// Every kernel compiled into this binary, with whether this CPU can run it.
+inline std::vector<Kernel> kernels() {
+    std::vector<Kernel> all;
+    all.push_back(Kernel{"scalar", find_word_scalar, true});
+#ifdef PID_SIMD_X86
+    __builtin_cpu_init();
+    all.push_back(Kernel{"sse2", find_word_sse2, __builtin_cpu_supports("sse2") != 0});
+    all.push_back(Kernel{"avx2", find_word_avx2, __builtin_cpu_supports("avx2") != 0});
+    all.push_back(Kernel{"avx512", find_word_avx512, __builtin_cpu_supports("avx512f") != 0});
+#endif
+    return all;
+}
+
+// The widest supported kernel.
+inline const Kernel& active() {
+    static const Kernel chosen = [] {
+        Kernel best{"scalar", find_word_scalar, true};
+        for (const Kernel& k : kernels()) {
+            if (k.supported) best = k;
+        }
+        return best;
+    }();
+    return chosen;
+}
+
+inline std::size_t find_word(const std::uint64_t* words, std::size_t from,
+                             std::size_t to, std::uint64_t skip) {
+    return active().fn(words, from, to, skip);
+}
+
+} // namespace simd_scan
@@ -0,0 +1,376 @@
+#pragma once
+#include <vector>
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include "pid_manager.hpp"
+
+// Roaring-style storage engine for very large, sparse PID spaces.
+//
+// The slot space is cut into 64K chunks keyed by the high bits of the slot.
+// Chunks with no allocated slot are simply absent, so an empty 2^31 range
+// costs nothing. Each present chunk picks one of three containers:
+//   Array  - sorted 16-bit offsets, 2 bytes per allocated slot
+//   Bitmap - 1024 x 64-bit words, a flat 8 KiB
+//   Run    - sorted [start, last] intervals, 4 bytes per run
+// The container is re-chosen after every change from the chunk's
+// cardinality and run count, which are both maintained incrementally. A
+// conversion only happens once the alternative is at least half the size of
+// the current container, so alternating set/clear at a threshold can't thrash.
+class SparseStorage {
+public:
+    enum class Kind : unsigned char { Array, Bitmap, Run };
+
+    void reset(std::size_t n) {
+        size_ = n;
+        keys.clear();
+        chunks.clear();
+    }
+
+    void resize(std::size_t n) {
+        size_ = n;  // chunks past n are already absent when shrinking
+    }
+
+    bool test(std::size_t slot) const {
+        std::size_t k = index_of(slot >> 16);
+        return k != npos && chunks[k].contains(static_cast<std::uint16_t>(slot & 0xFFFF));
+    }
+
+    void set(std::size_t slot) {
+        std::uint32_t hi = static_cast<std::uint32_t>(slot >> 16);
+        auto it = std::lower_bound(keys.begin(), keys.end(), hi);
+        std::size_t k = static_cast<std::size_t>(it - keys.begin());
+        if (it == keys.end() || *it != hi) {
+            keys.insert(it, hi);
+            chunks.insert(chunks.begin() + static_cast<std::ptrdiff_t>(k), Chunk());
+        }
+        chunks[k].add(static_cast<std::uint16_t>(slot & 0xFFFF));
+    }
+
+    void clear(std::size_t slot) {
+        std::size_t k = index_of(slot >> 16);
+        if (k == npos) return;
+        Chunk& c = chunks[k];
+        c.remove(static_cast<std::uint16_t>(slot & 0xFFFF));
+        if (c.card == 0) {
+            keys.erase(keys.begin() + static_cast<std::ptrdiff_t>(k));
+            chunks.erase(chunks.begin() + static_cast<std::ptrdiff_t>(k));
+        }
+    }
+
+    std::size_t find_clear(std::size_t from, std::size_t to) const {
+        if (from >= to) return to;
+        std::size_t hi = from >> 16;
+        std::uint32_t lo = static_cast<std::uint32_t>(from & 0xFFFF);
+        std::size_t k = static_cast<std::size_t>(
+            std::lower_bound(keys.begin(), keys.end(), static_cast<std::uint32_t>(hi)) - keys.begin());
+        for (;;) {
+            if (k == keys.size() || keys[k] != hi) {
+                // Absent chunk: every slot in it is free.
+                std::size_t slot = (hi << 16) + lo;
+                return slot < to ? slot : to;
+            }
+            std::uint32_t off = chunks[k].next_clear(lo);
+            if (off < kChunkSlots) {
+                std::size_t slot = (hi << 16) + off;
+                return slot < to ? slot : to;
+            }
+            ++hi;
+            ++k;
+            lo = 0;
+            if ((hi << 16) >= to) return to;
+        }
+    }
+
+    std::size_t find_set(std::size_t from, std::size_t to) const {
+        if (from >= to) return to;
+        std::size_t hi = from >> 16;
+        std::uint32_t lo = static_cast<std::uint32_t>(from & 0xFFFF);
+        std::size_t k = static_cast<std::size_t>(
+            std::lower_bound(keys.begin(), keys.end(), static_cast<std::uint32_t>(hi)) - keys.begin());
+        for (; k < keys.size(); ++k) {
+            if (keys[k] != hi) lo = 0;  // jumped over absent chunks
+            std::uint32_t off = chunks[k].next_set(lo);
+            if (off < kChunkSlots) {
+                std::size_t slot = (std::size_t(keys[k]) << 16) + off;
+                return slot < to ? slot : to;
+            }
+            lo = 0;
+            if ((std::size_t(keys[k]) + 1) << 16 >= to) break;
+        }
+        return to;
+    }
+
+    std::size_t take_clear(std::size_t from, std::size_t to, std::size_t count, std::size_t* out) {
+        std::size_t taken = 0;
+        for (std::size_t slot = find_clear(from, to); slot < to && taken < count;
+             slot = find_clear(slot + 1, to)) {
+            set(slot);
+            out[taken++] = slot;
+        }
+        return taken;
+    }
+
+    // Introspection, mainly for tests and sizing decisions.
+    std::size_t size() const { return size_; }
+    std::size_t chunk_count() const { return chunks.size(); }
+    Kind kind_of(std::size_t slot) const {
+        std::size_t k = index_of(slot >> 16);
+        return k == npos ? Kind::Array : chunks[k].kind;
+    }
+    std::size_t memory_usage() const {
+        std::size_t bytes = keys.capacity() * sizeof(std::uint32_t) + chunks.capacity() * sizeof(Chunk);
+        for (const Chunk& c : chunks) bytes += c.heap_bytes();
+        return bytes;
+    }
+
+private:
+    static constexpr std::size_t npos = static_cast<std::size_t>(-1);
+    static constexpr std::uint32_t kChunkSlots = 1u << 16;
+    static constexpr std::uint32_t kBitmapWords = kChunkSlots / 64;
+
+    struct Run {
+        std::uint16_t start;
+        std::uint16_t last;
+    };
+
+    struct Chunk {
+        Kind kind = Kind::Array;
+        std::uint32_t card = 0;  // allocated slots in this chunk
+        std::uint32_t runs = 0;  // maximal runs of allocated slots
+        std::vector<std::uint16_t> array;
+        std::vector<std::uint64_t> bits;
+        std::vector<Run> intervals;
+
+        bool contains(std::uint16_t v) const {
+            switch (kind) {
+            case Kind::Array:
+                return std::binary_search(array.begin(), array.end(), v);
+            case Kind::Bitmap:
+                return (bits[v >> 6] >> (v & 63)) & 1u;
+            case Kind::Run: {
+                std::size_t pos = run_upper(v);
+                return pos > 0 && intervals[pos - 1].last >= v;
+            }
+            }
+            return false;
+        }
+
+        void add(std::uint16_t v) {
+            if (contains(v)) return;
+            bool left = v > 0 && contains(static_cast<std::uint16_t>(v - 1));
+            bool right = v < 0xFFFF && contains(static_cast<std::uint16_t>(v + 1));
+            switch (kind) {
+            case Kind::Array:
+                array.insert(std::lower_bound(array.begin(), array.end(), v), v);
+                break;
+            case Kind::Bitmap:
+                bits[v >> 6] |= std::uint64_t(1) << (v & 63);
+                break;
+            case Kind::Run: {
+                std::size_t pos = run_upper(v);
+                if (left && right) {
+                    intervals[pos - 1].last = intervals[pos].last;
+                    intervals.erase(intervals.begin() + static_cast<std::ptrdiff_t>(pos));
+                } else if (left) {
+                    intervals[pos - 1].last = v;
+                } else if (right) {
+                    intervals[pos].start = v;
+                } else {
+                    intervals.insert(intervals.begin() + static_cast<std::ptrdiff_t>(pos), Run{v, v});
+                }
+                break;
+            }
+            }
+            ++card;
+            runs = runs + 1 - static_cast<std::uint32_t>(left) - static_cast<std::uint32_t>(right);
+            choose_container();
+        }
+
+        void remove(std::uint16_t v) {
+            if (!contains(v)) return;
+            bool left = v > 0 && contains(static_cast<std::uint16_t>(v - 1));
+            bool right = v < 0xFFFF && contains(static_cast<std::uint16_t>(v + 1));
+            switch (kind) {
+            case Kind::Array:
+                array.erase(std::lower_bound(array.begin(), array.end(), v));
+                break;
+            case Kind::Bitmap:
+                bits[v >> 6] &= ~(std::uint64_t(1) << (v & 63));
+                break;
+            case Kind::Run: {
+                std::size_t pos = run_upper(v) - 1;
+                Run& r = intervals[pos];
+                if (r.start == r.last) {
+                    intervals.erase(intervals.begin() + static_cast<std::ptrdiff_t>(pos));
+                } else if (v == r.start) {
+                    ++r.start;
+                } else if (v == r.last) {
+                    --r.last;
+                } else {
+                    Run tail{static_cast<std::uint16_t>(v + 1), r.last};
+                    r.last = static_cast<std::uint16_t>(v - 1);
+                    intervals.insert(intervals.begin() + static_cast<std::ptrdiff_t>(pos + 1), tail);
+                }
+                break;
+            }
+            }
+            --card;
+            runs = runs + static_cast<std::uint32_t>(left) + static_cast<std::uint32_t>(right) - 1;
+            if (card != 0) choose_container();
+        }
+
+        // First free offset >= v, or kChunkSlots if the rest of the chunk is full.
+        std::uint32_t next_clear(std::uint32_t v) const {
+            switch (kind) {
+            case Kind::Array: {
+                auto it = std::lower_bound(array.begin(), array.end(), static_cast<std::uint16_t>(v));
+                if (it == array.end() || *it != v) return v;
+                // array[i] - i is non-decreasing, so the run of consecutive
+                // offsets starting at v ends where it first exceeds v - k.
+                std::size_t k = static_cast<std::size_t>(it - array.begin());
+                std::size_t lo = k, hi = array.size();
+                while (lo < hi) {
+                    std::size_t mid = lo + (hi - lo) / 2;
+                    if (array[mid] - mid == v - k) lo = mid + 1;
+                    else hi = mid;
+                }
+                return v + static_cast<std::uint32_t>(lo - k);
+            }
+            case Kind::Bitmap: {
+                std::uint32_t w = v >> 6;
+                std::uint64_t free = ~bits[w] & (~std::uint64_t(0) << (v & 63));
+                while (free == 0) {
+                    if (++w == kBitmapWords) return kChunkSlots;
+                    free = ~bits[w];
+                }
+                return w * 64 + static_cast<std::uint32_t>(__builtin_ctzll(free));
+            }
+            case Kind::Run: {
+                std::size_t pos = run_upper(static_cast<std::uint16_t>(v));
+                if (pos > 0 && intervals[pos - 1].last >= v) return intervals[pos - 1].last + 1u;
+                return v;
+            }
+            }
+            return v;
+        }
+
+        // First allocated offset >= v, or kChunkSlots if there is none.
+        std::uint32_t next_set(std::uint32_t v) const {
+            switch (kind) {
+            case Kind::Array: {
+                auto it = std::lower_bound(array.begin(), array.end(), static_cast<std::uint16_t>(v));
+                return it == array.end() ? kChunkSlots : *it;
+            }
+            case Kind::Bitmap: {
+                std::uint32_t w = v >> 6;
+                std::uint64_t set = bits[w] & (~std::uint64_t(0) << (v & 63));
+                while (set == 0) {
+                    if (++w == kBitmapWords) return kChunkSlots;
+                    set = bits[w];
+                }
+                return w * 64 + static_cast<std::uint32_t>(__builtin_ctzll(set));
+            }
+            case Kind::Run: {
+                std::size_t pos = run_upper(static_cast<std::uint16_t>(v));
+                if (pos > 0 && intervals[pos - 1].last >= v) return v;
+                return pos < intervals.size() ? intervals[pos].start : kChunkSlots;
+            }
+            }
+            return kChunkSlots;
+        }
+
+        std::size_t heap_bytes() const {
+            return array.capacity() * sizeof(std::uint16_t) +
+                   bits.capacity() * sizeof(std::uint64_t) +
+                   intervals.capacity() * sizeof(Run);
+        }
+
+    private:
+        std::size_t run_upper(std::uint16_t v) const {
+            return static_cast<std::size_t>(
+                std::upper_bound(intervals.begin(), intervals.end(), v,
+                                 [](std::uint16_t x, const Run& r) { return x < r.start; }) -
+                intervals.begin());
+        }
+
+        std::size_t bytes_as(Kind k) const {
+            switch (k) {
+            case Kind::Array: return std::size_t(card) * sizeof(std::uint16_t);
+            case Kind::Bitmap: return kBitmapWords * sizeof(std::uint64_t);
+            case Kind::Run: return std::size_t(runs) * sizeof(Run);
+            }
+            return 0;
+        }
+
+        void choose_container() {
+            Kind best = Kind::Array;
+            if (bytes_as(Kind::Bitmap) < bytes_as(best)) best = Kind::Bitmap;
+            if (bytes_as(Kind::Run) < bytes_as(best)) best = Kind::Run;
+            if (best != kind && 2 * bytes_as(best) <= bytes_as(kind)) convert(best);
+        }
+
+        template <typename F>
+        void for_each(F f) const {
+            switch (kind) {
+            case Kind::Array:
+                for (std::uint16_t v : array) f(v);
+                break;
+            case Kind::Bitmap:
+                for (std::uint32_t w = 0; w < kBitmapWords; ++w) {
+                    for (std::uint64_t word = bits[w]; word != 0; word &= word - 1) {
+                        f(static_cast<std::uint16_t>(w * 64 + __builtin_ctzll(word)));
+                    }
+                }
+                break;
+            case Kind::Run:
+                for (const Run& r : intervals) {
+                    for (std::uint32_t v = r.start; v <= r.last; ++v) f(static_cast<std::uint16_t>(v));
+                }
+                break;
+            }
+        }
+
+        void convert(Kind to) {
+            std::vector<std::uint16_t> new_array;
+            std::vector<std::uint64_t> new_bits;
+            std::vector<Run> new_intervals;
+            switch (to) {
+            case Kind::Array:
+                new_array.reserve(card);
+                for_each([&](std::uint16_t v) { new_array.push_back(v); });
+                break;
+            case Kind::Bitmap:
+                new_bits.assign(kBitmapWords, 0);
+                for_each([&](std::uint16_t v) { new_bits[v >> 6] |= std::uint64_t(1) << (v & 63); });
+                break;
+            case Kind::Run:
+                new_intervals.reserve(runs);
+                for_each([&](std::uint16_t v) {
+                    if (!new_intervals.empty() && new_intervals.back().last + 1u == v) {
+                        new_intervals.back().last = v;
+                    } else {
+                        new_intervals.push_back(Run{v, v});
+                    }
+                });
+                break;
+            }
+            array.swap(new_array);
+            bits.swap(new_bits);
+            intervals.swap(new_intervals);
+            kind = to;
+        }
+    };
+
+    std::size_t index_of(std::size_t hi) const {
+        auto it = std::lower_bound(keys.begin(), keys.end(), static_cast<std::uint32_t>(hi));
+        if (it == keys.end() || *it != hi) return npos;
+        return static_cast<std::size_t>(it - keys.begin());
+    }
+
+    std::size_t size_ = 0;
+    std::vector<std::uint32_t> keys;   // chunk numbers (slot >> 16), sorted
+    std::vector<Chunk> chunks;         // parallel to keys
+};
+
+using SparsePIDManager = BasicPIDManager<SparseStorage>;
@@ -1,11 +1,32 @@
+#include <algorithm>
 #include <cassert>
+#include <climits>
 #include <cstdlib>
 #include <iostream>
 #include <random>
+#include <sstream>
+#include <string>
+#include <thread>
 #include <iterator>
+#include <map>
+#include <memory>
 #include <unordered_set>
 #include <vector>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/wait.h>
 #include "pid_manager.hpp"
+#include "sparse_storage.hpp"
+#include "trie_storage.hpp"
+#include "pid_namespace.hpp"
+#include "pid_lease.hpp"
+#include "pid_cgroup.hpp"
+#include "pid_protocol.hpp"
+#include "pid_server.hpp"
+#include "pid_shm_ring.hpp"
+#include "pid_uring.hpp"
+#include "pid_client.hpp"
+#include "pid_log.hpp"
 
 // Small helper to assert with a message
 #define CHECK(cond, msg) do { if (!(cond)) { \
@@ -161,9 +182,1952 @@ static void what_if_tests() {
     std::cout << "\n";
 }
 
+static void sparse_storage_tests() {
+    std::cout << "[Sparse Storage Tests]\n";
+
+    // 1) Same allocate/release sequence must give the same PIDs as the flat map,
+    //    across several 64K chunk boundaries.
+    {
+        ByteMapPIDManager flat(0, 200000);
+        SparsePIDManager sparse(0, 200000);
+        CHECK(flat.allocate_map() == 1 && sparse.allocate_map() == 1, "allocate_map must succeed");
+
+        std::mt19937 rng(777);
+        std::vector<int> live;
+        for (int i = 0; i < 300000; ++i) {
+            if (rng() % 3 != 0 || live.empty()) {
+                int a = flat.allocate_pid();
+                int b = sparse.allocate_pid();
+                CHECK(a == b, "sparse: allocation must match the flat map");
+                if (a != -1) live.push_back(a);
+            } else {
+                size_t k = rng() % live.size();
+                int pid = live[k];
+                live[k] = live.back();
+                live.pop_back();
+                flat.release_pid(pid);
+                sparse.release_pid(pid);
+                CHECK(!sparse.is_allocated(pid), "sparse: released pid must be free");
+            }
+        }
+        for (int pid : live) CHECK(sparse.is_allocated(pid), "sparse: live pid must be allocated");
+        std::cout << "  ✓ sparse storage matches flat map on a random workload\n";
+    }
+
+    // 2) Full 31-bit range: clustered allocations stay small and use run containers;
+    //    punching holes switches to array/bitmap containers and back.
+    {
+        SparsePIDManager m(0, INT_MAX);
+        CHECK(m.allocate_map() == 1, "allocate_map must succeed on a 2^31 range");
+        for (int i = 0; i < 100000; ++i) CHECK(m.allocate_pid() == i, "sequential allocation");
+        const SparseStorage& s = m.storage_engine();
+        CHECK(s.chunk_count() == 2, "100000 slots span two chunks");
+        CHECK(s.kind_of(0) == SparseStorage::Kind::Run, "dense chunk should be run-encoded");
+        CHECK(s.memory_usage() < 4096, "clustered allocations should cost a few bytes");
+
+        for (int pid = 0; pid < 65536; pid += 2) m.release_pid(pid);
+        CHECK(s.kind_of(0) == SparseStorage::Kind::Bitmap, "alternating slots should be a bitmap");
+        for (int pid = 1; pid < 65536; pid += 2) {
+            if (pid % 64 != 1) m.release_pid(pid);
+        }
+        CHECK(s.kind_of(0) == SparseStorage::Kind::Array, "few scattered slots should be an array");
+        CHECK(m.is_allocated(65) && !m.is_allocated(66), "contents survive container changes");
+        CHECK(m.allocate_pid() == 0, "release biases the cursor back to earlier frees");
+        CHECK(m.allocate_pid() == 2, "next free slot is found inside an array container");
+        std::cout << "  ✓ container switching on a 2^31 range\n";
+    }
+
+    // 3) Exhaustion and wrap-around across a chunk boundary.
+    {
+        SparsePIDManager m(65530, 65545);
+        CHECK(m.allocate_map() == 1, "allocate_map must succeed");
+        for (int i = 65530; i <= 65545; ++i) CHECK(m.allocate_pid() == i, "fill across boundary");
+        CHECK(m.allocate_pid() == -1, "sparse: exhausted range returns -1");
+        m.release_pid(65537);
+        CHECK(m.allocate_pid() == 65537, "sparse: freed slot past the boundary is found");
+        std::cout << "  ✓ exhaustion across a chunk boundary\n";
+    }
+
+    std::cout << "\n";
+}
+
+static void successor_tests() {
+    std::cout << "[Successor / Trie Storage Tests]\n";
+
+    // 1) Every storage engine must agree on allocations and successor queries.
+    {
+        const int lo = 7, hi = 300000;
+        ByteMapPIDManager flat(lo, hi);
+        PIDManager packed(lo, hi);
+        TriePIDManager trie(lo, hi);
+        SparsePIDManager sparse(lo, hi);
+        CHECK(flat.allocate_map() == 1 && packed.allocate_map() == 1 &&
+              trie.allocate_map() == 1 && sparse.allocate_map() == 1, "allocate_map must succeed");
+        CHECK(trie.storage_engine().levels() == 4, "300K slots need a 4-level trie");
+
+        std::mt19937 rng(4242);
+        std::vector<int> live;
+        for (int i = 0; i < 400000; ++i) {
+            if (rng() % 4 != 0 || live.empty()) {
+                int a = flat.allocate_pid();
+                CHECK(packed.allocate_pid() == a && trie.allocate_pid() == a && sparse.allocate_pid() == a,
+                      "all engines must allocate the same pid");
+                if (a != -1) live.push_back(a);
+            } else {
+                size_t k = rng() % live.size();
+                int pid = live[k];
+                live[k] = live.back();
+                live.pop_back();
+                flat.release_pid(pid);
+                packed.release_pid(pid);
+                trie.release_pid(pid);
+                sparse.release_pid(pid);
+            }
+            if (i % 97 == 0) {
+                int q = lo + static_cast<int>(rng() % (hi - lo + 1));
+                int f = flat.next_free(q), s = flat.next_allocated(q);
+                CHECK(packed.next_free(q) == f && trie.next_free(q) == f && sparse.next_free(q) == f,
+                      "next_free must agree across engines");
+                CHECK(packed.next_allocated(q) == s && trie.next_allocated(q) == s &&
+                      sparse.next_allocated(q) == s, "next_allocated must agree across engines");
+            }
+        }
+        std::cout << "  ✓ byte map, packed bitmap, trie and sparse engines agree\n";
+    }
+
+    // 2) Successor edge cases on the trie.
+    {
+        TriePIDManager m(0, 64 * 64 * 64 + 5);
+        CHECK(m.allocate_map() == 1, "allocate_map must succeed");
+        CHECK(m.next_allocated(0) == -1, "empty map has no allocated successor");
+        CHECK(m.next_free(m.max()) == m.max(), "last pid is free");
+        for (int i = 0; i <= m.max(); ++i) m.allocate_pid();
+        CHECK(m.allocate_pid() == -1, "trie: exhausted range returns -1");
+        CHECK(m.next_free(0) == -1, "full map has no free successor");
+        m.release_pid(200000);
+        CHECK(m.next_free(3) == 200000, "free successor jumps over full subtrees");
+        CHECK(m.next_allocated(200000) == 200001, "allocated successor skips the hole");
+        CHECK(m.allocate_pid() == 200000, "freed slot is reused");
+        CHECK(m.next_free(-5) == -1 && m.next_allocated(m.max() + 1) == -1, "out-of-range queries");
+        std::cout << "  ✓ trie successor queries\n";
+    }
+
+    std::cout << "\n";
+}
+
+static void simd_scan_tests() {
+    std::cout << "[SIMD Scan Tests]\n";
+
+    std::mt19937 rng(99);
+    std::vector<std::uint64_t> words(1000);
+    for (const simd_scan::Kernel& k : simd_scan::kernels()) {
+        if (!k.supported) {
+            std::cout << "  - " << k.name << " not supported on this CPU, skipped\n";
+            continue;
+        }
+        for (int round = 0; round < 2000; ++round) {
+            std::uint64_t skip = (round & 1) ? ~std::uint64_t(0) : 0;
+            std::fill(words.begin(), words.end(), skip);
+            // Zero, one or a few differing words, anywhere (including the tail).
+            int diffs = static_cast<int>(rng() % 4);
+            for (int d = 0; d < diffs; ++d) {
+                words[rng() % words.size()] ^= std::uint64_t(1) << (rng() % 64);
+            }
+            size_t from = rng() % words.size();
+            size_t to = from + rng() % (words.size() - from + 1);
+            size_t want = simd_scan::find_word_scalar(words.data(), from, to, skip);
+            CHECK(k.fn(words.data(), from, to, skip) == want, "kernel must match the scalar scan");
+        }
+        std::cout << "  ✓ " << k.name << " kernel matches scalar"
+                  << (std::string(k.name) == simd_scan::active().name ? " (active)" : "") << "\n";
+    }
+    std::cout << "\n";
+}
+
+template <typename Manager>
+static void resize_checks(const char* name) {
+    // Grow one step at a time from a full range; every new PID must be handed out.
+    {
+        Manager m(10, 20);
+        CHECK(m.allocate_map() == 1, "allocate_map must succeed");
+        for (int i = 10; i <= 20; ++i) m.allocate_pid();
+        CHECK(m.allocate_pid() == -1, "resize: range starts full");
+        for (int top = 21; top <= 5000; ++top) {
+            CHECK(m.resize(top) == 1, "resize: growth is applied immediately");
+            CHECK(m.allocate_pid() == top, "resize: the new slot is allocated next");
+        }
+        CHECK(m.allocate_pid() == -1 && m.max() == 5000, "resize: grown range is full");
+        for (int pid = 10; pid <= 5000; pid += 7) CHECK(m.is_allocated(pid), "resize: growth keeps allocations");
+    }
+
+    // Shrinking below a live PID is deferred until it is released.
+    {
+        Manager m(0, 999);
+        CHECK(m.allocate_map() == 1, "allocate_map must succeed");
+        for (int i = 0; i < 600; ++i) m.allocate_pid();
+        for (int pid = 100; pid < 600; ++pid) {
+            if (pid != 450) m.release_pid(pid);
+        }
+        CHECK(m.resize(200) == 0 && m.resize_pending(), "resize: shrink below a live pid is deferred");
+        CHECK(m.max() == 200 && !m.in_range(450), "resize: deferred limit applies to the range");
+        CHECK(m.is_allocated(450), "resize: pid above the limit stays live");
+        for (int i = 100; i <= 200; ++i) CHECK(m.allocate_pid() == i, "resize: allocations stay below the limit");
+        CHECK(m.allocate_pid() == -1, "resize: nothing is handed out above the limit");
+        m.release_pid(450);
+        CHECK(!m.resize_pending(), "resize: releasing the last high pid completes the shrink");
+        CHECK(m.resize(100) == 0, "resize: another deferred shrink");
+        CHECK(m.resize(300) == 1 && !m.resize_pending(), "resize: growing cancels a pending shrink");
+        CHECK(m.allocate_pid() == 201, "resize: allocation resumes after regrowth");
+        CHECK(m.resize(-1) == -1 && m.resize(m.min() - 1) == -1, "resize: invalid limits are rejected");
+    }
+    std::cout << "  ✓ " << name << " grows in place and defers shrinking\n";
+}
+
+static void resize_tests() {
+    std::cout << "[Resize Tests]\n";
+    resize_checks<PIDManager>("bitmap");
+    resize_checks<ByteMapPIDManager>("bytemap");
+    resize_checks<TriePIDManager>("trie");
+    resize_checks<SparsePIDManager>("sparse");
+
+    // The trie rebuilds summary levels incrementally; check it against the byte
+    // map while the range moves up and down through level boundaries.
+    {
+        ByteMapPIDManager flat(0, 50);
+        TriePIDManager trie(0, 50);
+        CHECK(flat.allocate_map() == 1 && trie.allocate_map() == 1, "allocate_map must succeed");
+        std::mt19937 rng(31337);
+        for (int i = 0; i < 200000; ++i) {
+            unsigned op = rng() % 100;
+            if (op == 0) {
+                int top = 1 + static_cast<int>(rng() % 300000);
+                CHECK(flat.resize(top) == trie.resize(top), "trie: resize result must match");
+            } else if (op < 70) {
+                CHECK(flat.allocate_pid() == trie.allocate_pid(), "trie: allocation after resize must match");
+            } else {
+                int pid = flat.next_allocated(static_cast<int>(rng() % 300000));
+                if (pid != -1) {
+                    flat.release_pid(pid);
+                    trie.release_pid(pid);
+                }
+            }
+            if (i % 101 == 0) {
+                int q = static_cast<int>(rng() % 300000);
+                CHECK(flat.next_free(q) == trie.next_free(q) && flat.next_allocated(q) == trie.next_allocated(q),
+                      "trie: successor queries must match after resize");
+            }
+        }
+        std::cout << "  ✓ trie summaries stay consistent across random resizes\n";
+    }
+    std::cout << "\n";
+}
+
+static void hole_tests() {
+    std::cout << "[Non-contiguous Range Tests]\n";
+
+    // 1) Allocation walks the intervals in order and jumps straight over holes.
+    {
+        PIDManager m(std::vector<PIDRange>{{1000, 1099}, {100, 199}, {5000, 5000}, {200, 209}});
+        CHECK(m.allocate_map() == 1, "allocate_map must succeed");
+        CHECK(m.capacity() == 211, "holes must not count towards capacity");
+        CHECK(m.ranges().size() == 3, "adjacent intervals are merged");
+        CHECK(m.min() == 100 && m.max() == 5000, "min/max span all intervals");
+        CHECK(!m.in_range(500) && !m.in_range(1100) && m.in_range(5000), "holes are out of range");
+
+        std::vector<int> got;
+        for (int pid = m.allocate_pid(); pid != -1; pid = m.allocate_pid()) got.push_back(pid);
+        CHECK(got.size() == 211, "every usable pid is handed out exactly once");
+        CHECK(got[109] == 209 && got[110] == 1000 && got[210] == 5000, "cursor steps across holes");
+        for (int pid : got) CHECK(m.in_range(pid), "allocated pids never fall in a hole");
+
+        m.release_pid(500); // hole: no-op
+        CHECK(m.allocate_pid() == -1, "releasing a hole pid frees nothing");
+        m.release_pid(1050);
+        m.release_pid(150);
+        CHECK(m.next_free(300) == 1050, "next_free from a hole starts at the next interval");
+        CHECK(m.next_allocated(1100) == 5000, "next_allocated skips the hole");
+        CHECK(m.allocate_pid() == 150 && m.allocate_pid() == 1050, "released pids are reused in order");
+    }
+
+    // 2) The sparse engine stores only the slots of the intervals, and resize
+    //    moves the end of the last interval.
+    {
+        SparsePIDManager m(std::vector<PIDRange>{{0, 999}, {2000000000, 2000000999}});
+        CHECK(m.allocate_map() == 1, "allocate_map must succeed");
+        CHECK(m.storage_engine().size() == 2000, "hole costs no slots");
+        for (int i = 0; i < 2000; ++i) m.allocate_pid();
+        CHECK(m.is_allocated(2000000999) && m.allocate_pid() == -1, "both intervals fill up");
+        CHECK(m.resize(2000001009) == 1 && m.allocate_pid() == 2000001000, "resize extends the last interval");
+        CHECK(m.resize(999) == -1, "resize cannot cut into an earlier interval");
+    }
+
+    // 3) Overlapping intervals are rejected.
+    {
+        bool threw = false;
+        try {
+            PIDManager bad(std::vector<PIDRange>{{10, 20}, {15, 30}});
+        } catch (const std::invalid_argument&) {
+            threw = true;
+        }
+        CHECK(threw, "overlapping intervals must throw");
+    }
+
+    std::cout << "  ✓ holes cost no slots and are skipped by the cursor\n\n";
+}
+
+static void pool_tests() {
+    std::cout << "[Pool Tests]\n";
+
+    PIDManager m(1, 1000);
+    int sys = m.add_pool("system", 1, 99);
+    int user = m.add_pool("user", 100, 899);
+    int batch = m.add_pool("batch", 900, 1000);
+    CHECK(sys == 0 && user == 1 && batch == 2, "pools get sequential ids");
+    CHECK(m.add_pool("overlap", 50, 150) == -1, "overlapping pools are rejected");
+    CHECK(m.add_pool("user", 1, 1) == -1, "duplicate pool names are rejected");
+    CHECK(m.add_pool("outside", 900, 2000) == -1, "pools must lie in the PID space");
+    CHECK(m.pool_id("batch") == batch && m.pool_id("nope") == -1, "pool lookup by name");
+    CHECK(m.allocate_pid(sys) == -1, "pool allocation before allocate_map returns -1");
+    CHECK(m.allocate_map() == 1, "allocate_map must succeed");
+
+    // A runaway batch class exhausts its own pool but can't touch the others.
+    for (int i = 0; i < 101; ++i) {
+        int pid = m.allocate_pid(batch);
+        CHECK(pid >= 900 && pid <= 1000, "batch pids come from the batch pool");
+    }
+    CHECK(m.allocate_pid(batch) == -1, "batch pool is exhausted");
+    CHECK(m.allocate_pid(sys) == 1 && m.allocate_pid(user) == 100, "other pools are unaffected");
+
+    // Spillover: user may borrow from batch, system from user.
+    CHECK(m.set_spillover(user, {batch}) == 1 && m.set_spillover(sys, {user}) == 1, "set spillover");
+    CHECK(m.set_spillover(sys, {sys}) == -1 && m.set_spillover(7, {}) == -1, "invalid spillover rejected");
+    m.release_pid(950);
+    for (int i = 101; i < 900; ++i) CHECK(m.allocate_pid(user) == i, "user pool fills in order");
+    CHECK(m.allocate_pid(user) == 950, "full user pool spills into batch");
+    CHECK(m.allocate_pid(user) == -1, "spillover target is full too");
+
+    for (int i = 2; i < 100; ++i) m.allocate_pid(sys);
+    m.release_pid(300);
+    CHECK(m.allocate_pid(sys) == 300, "system spills into user");
+    CHECK(m.allocate_pid(sys) == -1, "spillover is one level deep");
+
+    // Release biases the owning pool's cursor back to the freed pid.
+    m.release_pid(42);
+    m.release_pid(17);
+    CHECK(m.allocate_pid(sys) == 17 && m.allocate_pid(sys) == 42, "pool reuses its lowest frees first");
+    CHECK(m.allocate_pid(-1) == -1 && m.allocate_pid(3) == -1, "invalid pool ids return -1");
+    CHECK(m.allocate_pid() == -1, "whole space is full");
+
+    // The default allocator stays out of pools, including after the range
+    // grows, and an all-or-nothing request can't be met from a pool.
+    {
+        PIDManager d(1, 200);
+        int p = d.add_pool("reserved", 50, 99);
+        CHECK(d.allocate_map() == 1, "allocate_map must succeed");
+        std::vector<int> got;
+        for (int pid = d.allocate_pid(); pid != -1; pid = d.allocate_pid()) got.push_back(pid);
+        CHECK(got.size() == 150, "every PID outside the pool is handed out");
+        for (int pid : got) CHECK(pid < 50 || pid > 99, "default PIDs never come from a pool");
+        std::vector<int> batch;
+        CHECK(d.allocate_atomic(1, batch) == -1 && batch.empty() && d.free_count() == 50, "pool PIDs don't satisfy allocate_atomic");
+        CHECK(d.allocate_pid(p) == 50, "the pool still has all of them");
+        d.release_pid(50);
+        d.release_pid(120);
+        CHECK(d.allocate_pid() == 120, "a pool release leaves the default cursor alone");
+        CHECK(d.resize(210) == 1 && d.allocate_atomic(10, batch) == 1 && batch.front() == 201, "grown PIDs are open");
+    }
+
+    std::cout << "  ✓ named pools, isolation and spillover\n\n";
+}
+
+static void namespace_tests() {
+    std::cout << "[Namespace Tests]\n";
+
+    PIDNamespaceTree tree(100, 1000, 2);
+    int a = tree.create_namespace(0, 1, 100);
+    int b = tree.create_namespace(a, 1, 3);
+    int c = tree.create_namespace(0, 1, 100);
+    CHECK(a == 1 && b == 2 && c == 3, "namespaces get sequential ids");
+    CHECK(tree.level(b) == 2 && tree.parent(b) == a, "nesting is recorded");
+    CHECK(tree.create_namespace(b) == -1, "max depth is enforced");
+    CHECK(tree.create_namespace(42) == -1, "invalid parent is rejected");
+
+    // A process in b gets a PID in b, a and the root.
+    int g1 = tree.alloc(b);
+    CHECK(g1 == 100, "global pid comes from the root manager");
+    CHECK(tree.to_local(g1, b) == 1 && tree.to_local(g1, a) == 1 && tree.to_local(g1, 0) == g1,
+          "process is visible in every ancestor");
+    CHECK(tree.to_global(1, b) == g1 && tree.to_global(1, a) == g1, "local -> global");
+    CHECK(tree.namespace_of(g1) == b, "creation namespace is recorded");
+
+    // A process in a is invisible in its child b; one in c is invisible in a.
+    int g2 = tree.alloc(a);
+    int g3 = tree.alloc(c);
+    CHECK(tree.to_local(g2, a) == 2 && tree.to_local(g2, b) == -1, "parent-level process hidden from child");
+    CHECK(tree.to_local(g3, c) == 1 && tree.to_local(g3, a) == -1, "sibling namespaces are isolated");
+    CHECK(tree.to_global(1, c) == g3 && tree.to_global(50, c) == -1, "unused local pid maps to -1");
+
+    // Exhausting b rolls back the PIDs already taken in a and the root.
+    CHECK(tree.alloc(b) != -1 && tree.alloc(b) != -1, "fill b");
+    int before_a = tree.manager(a).next_free(1);
+    int before_root = tree.manager(0).next_free(100);
+    CHECK(tree.alloc(b) == -1, "b is exhausted");
+    CHECK(tree.manager(a).next_free(1) == before_a && tree.manager(0).next_free(100) == before_root,
+          "failed alloc leaves no partial allocation");
+
+    // Release frees the PID at every level.
+    tree.release(g1);
+    CHECK(tree.to_local(g1, a) == -1 && tree.to_global(1, b) == -1, "released pid is gone everywhere");
+    CHECK(!tree.manager(a).is_allocated(1) && !tree.manager(0).is_allocated(g1), "released in every manager");
+    int g4 = tree.alloc(b);
+    CHECK(g4 != -1 && tree.to_local(g4, b) == 1, "freed local pid is reused");
+    tree.release(999); // not live: no-op
+    tree.release(5000); // out of range: no-op
+    CHECK(tree.to_local(g4, b) == 1 && tree.to_local(g2, a) == 2, "releasing a dead pid is a no-op");
+
+    std::cout << "  ✓ nested allocation, translation and rollback\n\n";
+}
+
+static void metadata_tests() {
+    std::cout << "[Metadata Tests]\n";
+
+    PIDManager m(100, 199);
+    PIDInfo info;
+    CHECK(m.enable_metadata() == 1 && m.has_metadata(), "metadata can be enabled before allocate_map");
+    CHECK(m.allocate_map() == 1, "allocate_map must succeed");
+
+    int p1 = m.allocate_pid_for(7);
+    int p2 = m.allocate_pid_for(8, p1);
+    int p3 = m.allocate_pid();
+    CHECK(m.get_info(p1, info) && info.owner == 7 && info.parent == -1, "owner recorded on allocate");
+    std::uint64_t t1 = info.created_ns;
+    CHECK(m.get_info(p2, info) && info.owner == 8 && info.parent == p1, "parent recorded on allocate");
+    CHECK(info.created_ns >= t1 && t1 != 0, "creation timestamps are monotonic");
+    CHECK(m.get_info(p3, info) && info.owner == 0, "plain allocate_pid records no owner");
+
+    m.release_pid(p2);
+    CHECK(!m.get_info(p2, info), "released pid has no metadata");
+    int p4 = m.allocate_pid_for(9);
+    CHECK(p4 == p2 && m.get_info(p4, info) && info.owner == 9 && info.parent == -1,
+          "reused slot carries only the new owner's metadata");
+
+    // Metadata follows resize, and can be switched on for a live map.
+    CHECK(m.resize(1000) == 1, "grow");
+    for (int pid = m.next_free(100); pid != -1 && pid < 600; pid = m.next_free(pid)) m.allocate_pid_for(3);
+    CHECK(m.get_info(599, info) && info.owner == 3, "metadata covers grown slots");
+
+    PIDManager late(1, 50);
+    late.allocate_map();
+    int q = late.allocate_pid();
+    CHECK(!late.get_info(q, info), "no metadata until enabled");
+    CHECK(late.enable_metadata() == 1 && late.get_info(q, info) && info.owner == 0,
+          "enabling on a live map covers existing pids");
+
+    std::cout << "  ✓ owner / parent / timestamp side table\n\n";
+}
+
+static void owner_index_tests() {
+    std::cout << "[Owner Index Tests]\n";
+
+    PIDManager m(1, 5000);
+    CHECK(m.release_all(1) == 0, "release_all before allocate_map is a no-op");
+    CHECK(m.enable_metadata() == 1 && m.allocate_map() == 1, "init with metadata");
+
+    std::mt19937 rng(5150);
+    std::vector<std::vector<int>> held(5);
+    for (int i = 0; i < 3000; ++i) {
+        std::uint32_t owner = 1 + static_cast<std::uint32_t>(rng() % 4);
+        int pid = m.allocate_pid_for(owner);
+        CHECK(pid != -1, "allocate_pid_for within capacity");
+        held[owner].push_back(pid);
+        if (rng() % 3 == 0) {
+            // Individual releases unlink from the middle of an owner's list.
+            size_t k = rng() % held[owner].size();
+            m.release_pid(held[owner][k]);
+            held[owner][k] = held[owner].back();
+            held[owner].pop_back();
+        }
+    }
+    int unowned = m.allocate_pid();
+    for (std::uint32_t o = 1; o <= 4; ++o) {
+        CHECK(m.owned_count(o) == held[o].size(), "per-owner count matches");
+    }
+
+    CHECK(m.release_all(2) == held[2].size(), "release_all frees exactly the owner's pids");
+    CHECK(m.owned_count(2) == 0, "owner count drops to zero");
+    for (int pid : held[2]) CHECK(!m.is_allocated(pid), "owner's pids are free");
+    for (int pid : held[3]) CHECK(m.is_allocated(pid), "other owners are untouched");
+    CHECK(m.is_allocated(unowned), "unowned pids are untouched");
+    CHECK(m.release_all(2) == 0 && m.release_all(99) == 0 && m.release_all(0) == 0,
+          "release_all on empty, unknown or unowned ids frees nothing");
+
+    // Freed slots are reused by the next allocation.
+    int lowest = *std::min_element(held[2].begin(), held[2].end());
+    CHECK(m.allocate_pid_for(4) == lowest, "release_all biases the cursor to the lowest freed pid");
+
+    // Owner ids past the bound, the poison value among them, are refused
+    // before the per-owner table could grow to match.
+    std::vector<int> batch;
+    std::size_t before = m.free_count();
+    CHECK(m.allocate_pid_for(0xDEADDEADu) == -1 && m.allocate_pid_for(PIDManager::kMaxOwner + 1) == -1,
+          "poison and oversized owners are rejected");
+    CHECK(m.allocate_atomic(2, batch, 0xFFFFFFF0u) == -1 && batch.empty(), "allocate_atomic checks the owner");
+    int token = m.reserve_pid();
+    CHECK(m.commit(token, 0xDEADDEADu) == -1 && m.commit(token, PIDManager::kMaxOwner) == 1,
+          "commit checks the owner; the largest valid id works");
+    CHECK(m.owned_count(PIDManager::kMaxOwner) == 1 && m.release_all(PIDManager::kMaxOwner) == 1, "kMaxOwner is a real owner");
+    CHECK(m.free_count() == before, "rejected calls allocate nothing");
+    CHECK(m.owned_count(4) == held[4].size() + 1, "reused slot joins the new owner's list");
+
+    std::cout << "  ✓ O(k) release_all and O(1) owned_count\n\n";
+}
+
+static void reservation_tests() {
+    std::cout << "[Reservation Tests]\n";
+
+    PIDManager m(1, 10);
+    CHECK(m.reserve_pid() == -1, "reserve_pid before allocate_map returns -1");
+    CHECK(m.enable_metadata() == 1 && m.allocate_map() == 1, "init");
+
+    int a = m.allocate_pid();                 // 1
+    int t = m.reserve_pid();                  // 2
+    CHECK(t == 2 && !m.is_allocated(t), "reserved pid is invisible to is_allocated");
+    CHECK(m.allocate_pid() == 3, "reserved pid isn't handed out again");
+    m.release_pid(t);
+    CHECK(m.reservations() == 1, "release_pid leaves a reservation alone");
+
+    CHECK(m.abort(t) == 1 && !m.is_allocated(t), "abort frees the pid");
+    CHECK(m.abort(t) == -1 && m.commit(t) == -1, "a token can only be settled once");
+    CHECK(m.allocate_pid() == 4, "abort doesn't pull the cursor back");
+    CHECK(m.reserve_pid() == t, "aborted pid is reused by the next reservation");
+
+    PIDInfo info;
+    CHECK(m.commit(t, 42, a) == 1 && m.is_allocated(t), "commit makes the pid allocated");
+    CHECK(m.get_info(t, info) && info.owner == 42 && info.parent == a, "commit records metadata");
+    CHECK(m.owned_count(42) == 1, "committed pid joins the owner index");
+
+    // A spare slot taken by a regular allocation in the meantime is skipped.
+    int u = m.reserve_pid();
+    CHECK(m.abort(u) == 1, "abort");
+    m.release_pid(a);
+    CHECK(m.allocate_pid() == a, "cursor still returns to released pids");
+    for (int pid = m.allocate_pid(); pid != -1; pid = m.allocate_pid()) {}
+    CHECK(m.reserve_pid() == -1, "reserve_pid on a full map returns -1");
+    m.release_pid(7);
+    CHECK(m.reserve_pid() == 7, "stale spare slots are skipped");
+    CHECK(m.commit(3) == -1 && m.commit(-5) == -1, "non-reserved tokens are rejected");
+
+    // Thousands outstanding at once: each stays invisible and untouchable
+    // until settled, in any order, and survives the range growing.
+    {
+        PIDManager big(1, 20000);
+        big.allocate_map();
+        std::vector<int> tokens;
+        for (int i = 0; i < 10000; ++i) tokens.push_back(big.reserve_pid());
+        CHECK(big.reservations() == 10000 && big.resize(30000) == 1, "many reservations");
+        for (int tok : tokens) {
+            big.release_pid(tok);
+            CHECK(!big.is_allocated(tok), "reserved pid stays invisible");
+        }
+        for (std::size_t i = tokens.size(); i-- > 0;) {
+            CHECK((i % 2 ? big.commit(tokens[i]) : big.abort(tokens[i])) == 1, "settled in reverse order");
+        }
+        CHECK(big.reservations() == 0 && big.free_count() == big.capacity() - 5000, "half committed");
+    }
+
+    // Iteration agrees with is_allocated: successor queries skip reserved
+    // PIDs (which aren't free either) until they are committed.
+    {
+        PIDManager it(1, 10);
+        it.allocate_map();
+        int a = it.allocate_pid();
+        int r1 = it.reserve_pid();
+        int r2 = it.reserve_pid();
+        int b = it.allocate_pid();
+        CHECK(a == 1 && r1 == 2 && r2 == 3 && b == 4, "allocated around reservations");
+        std::vector<int> seen;
+        for (int p = it.next_allocated(1); p != -1; p = it.next_allocated(p + 1)) seen.push_back(p);
+        CHECK((seen == std::vector<int>{1, 4}), "reserved PIDs not iterated");
+        CHECK(it.next_allocated(2) == 4 && it.next_free(2) == 5, "a reservation is neither allocated nor free");
+        CHECK(it.commit(r2) == 1 && it.next_allocated(2) == 3, "committed PIDs are iterated");
+        CHECK(it.abort(r1) == 1 && it.next_free(1) == 2, "aborted PIDs are free");
+    }
+
+    std::cout << "  ✓ reserve / commit / abort\n\n";
+}
+
+template <typename Manager>
+static void atomic_checks(const char* name) {
+    Manager m(0, 299);
+    std::vector<int> pids;
+    CHECK(m.allocate_atomic(3, pids) == -1 && pids.empty(), "allocate_atomic before allocate_map fails");
+    CHECK(m.allocate_map() == 1, "allocate_map must succeed");
+    CHECK(m.free_count() == 300, "free_count starts at capacity");
+
+    // Fragment the map so batches have to pick scattered slots across words.
+    for (int i = 0; i < 300; ++i) m.allocate_pid();
+    for (int pid = 0; pid < 300; pid += 3) m.release_pid(pid);
+    m.release_pid(0); // already free: must not change the count
+    CHECK(m.free_count() == 100, "free_count tracks releases");
+
+    CHECK(m.allocate_atomic(70, pids) == 1 && pids.size() == 70, "batch allocation succeeds");
+    std::unordered_set<int> seen(pids.begin(), pids.end());
+    CHECK(seen.size() == 70, "batch pids are distinct");
+    for (int pid : pids) CHECK(pid % 3 == 0 && m.is_allocated(pid), "batch takes the free slots");
+    CHECK(m.free_count() == 30, "free_count after batch");
+
+    std::vector<int> more;
+    CHECK(m.allocate_atomic(31, more) == -1 && more.empty(), "oversized request fails");
+    CHECK(m.free_count() == 30 && m.next_free(0) != -1, "failed request leaves nothing behind");
+
+    // The cursor sits after the last batch; a request for the rest wraps around.
+    m.release_pid(pids[5]);
+    CHECK(m.allocate_atomic(31, more) == 1 && more.size() == 31, "request that wraps the cursor");
+    CHECK(m.free_count() == 0 && m.allocate_pid() == -1, "map is full");
+    CHECK(m.allocate_atomic(0, more) == 1 && m.allocate_atomic(-1, more) == -1, "edge sizes");
+    std::cout << "  ✓ " << name << " all-or-nothing batches\n";
+}
+
+static void atomic_tests() {
+    std::cout << "[Atomic Batch Tests]\n";
+    atomic_checks<PIDManager>("bitmap");
+    atomic_checks<ByteMapPIDManager>("bytemap");
+    atomic_checks<TriePIDManager>("trie");
+    atomic_checks<SparsePIDManager>("sparse");
+    std::cout << "\n";
+}
+
+static void lease_tests() {
+    std::cout << "[Lease Tests]\n";
+
+    // 1) Basic expiry, renewal and early release.
+    {
+        PIDManager m(1, 100);
+        m.allocate_map();
+        PIDLeases leases(m);
+        int a = leases.acquire(10);
+        int b = leases.acquire(20);
+        int c = leases.acquire(5000);
+        CHECK(a == 1 && b == 2 && c == 3 && leases.size() == 3, "acquire hands out leased pids");
+        std::vector<int> expired;
+        CHECK(leases.advance(9, &expired) == 0, "nothing expires early");
+        CHECK(leases.renew(std::vector<int>{a, 99}, 100) == 1, "batch renew skips unleased pids");
+        CHECK(leases.advance(20, &expired) == 1 && expired == std::vector<int>{b}, "b expires at its deadline");
+        CHECK(!m.is_allocated(b) && !leases.leased(b), "expired pid is released");
+        CHECK(leases.expires_at(a) == 109, "renewed expiry");
+        leases.release(c);
+        CHECK(!m.is_allocated(c) && leases.size() == 1, "early release cancels the lease");
+        CHECK(leases.advance(109) == 1 && !m.is_allocated(a), "renewed lease expires at the new deadline");
+        CHECK(leases.advance(1000000) == 0 && leases.now() == 1000000, "idle wheel jumps forward");
+
+        std::vector<int> group;
+        CHECK(leases.acquire_many(5, 3, group) == 1 && group.size() == 5, "leased batch");
+        CHECK(leases.advance(1000003) == 5, "batch expires together");
+    }
+
+    // 2) Random workload against a reference map, with deadlines beyond the wheel span.
+    {
+        PIDManager m(0, 4999);
+        m.allocate_map();
+        PIDLeases leases(m, 12345);
+        std::map<int, std::uint64_t> ref;
+        std::mt19937_64 rng(8);
+        for (int round = 0; round < 400; ++round) {
+            for (int i = 0; i < 10; ++i) {
+                std::uint64_t ttl = (rng() % 10 == 0) ? 1 + rng() % (std::uint64_t(1) << 25) : 1 + rng() % 70000;
+                int pid = leases.acquire(ttl);
+                if (pid != -1) ref[pid] = leases.now() + ttl;
+            }
+            if (!ref.empty() && rng() % 2) {
+                auto it = ref.begin();
+                std::advance(it, static_cast<long>(rng() % ref.size()));
+                std::uint64_t ttl = 1 + rng() % 5000;
+                CHECK(leases.renew(it->first, ttl) == 1, "renew a live lease");
+                it->second = leases.now() + ttl;
+            }
+            std::uint64_t to = leases.now() + 1 + rng() % 40000;
+            std::vector<int> expired;
+            leases.advance(to, &expired);
+            std::vector<int> want;
+            for (auto it = ref.begin(); it != ref.end();) {
+                if (it->second <= to) {
+                    want.push_back(it->first);
+                    it = ref.erase(it);
+                } else {
+                    ++it;
+                }
+            }
+            std::sort(expired.begin(), expired.end());
+            CHECK(expired == want, "wheel expires exactly the due leases");
+        }
+        // Drain the far-future leases through the overflow bucket.
+        std::vector<int> expired;
+        leases.advance(leases.now() + (std::uint64_t(1) << 26), &expired);
+        CHECK(expired.size() == ref.size() && leases.size() == 0, "far leases expire after overflow cascades");
+    }
+
+    // 3) Long jumps with leases live only visit the ticks where a bucket is
+    // due; stepping one tick at a time here would take hours.
+    {
+        PIDManager m(0, 99);
+        m.allocate_map();
+        PIDLeases leases(m, 7);
+        const std::uint64_t far = std::uint64_t(1) << 40;
+        int a = leases.acquire(far);
+        int b = leases.acquire(std::uint64_t(1) << 30);
+        CHECK(leases.advance(7 + (std::uint64_t(1) << 30) - 1) == 0 && leases.size() == 2, "jump just short of b");
+        std::vector<int> expired;
+        CHECK(leases.advance(7 + (std::uint64_t(1) << 30), &expired) == 1 && expired == std::vector<int>{b},
+              "b expires on its exact tick");
+        CHECK(leases.renew(a, far) == 1 && leases.expires_at(a) == leases.now() + far, "renew mid-jump");
+        CHECK(leases.advance(leases.now() + far - 1) == 0 && m.is_allocated(a), "a survives to its last tick");
+        CHECK(leases.advance(leases.now() + 1) == 1 && leases.size() == 0, "then expires");
+    }
+
+    std::cout << "  ✓ timer-wheel lease expiry matches a reference model\n\n";
+}
+
+static void process_tree_tests() {
+    std::cout << "[Process Tree Tests]\n";
+
+    PIDManager m(1, 200);
+    m.allocate_map();
+    m.enable_metadata();
+    int init = m.allocate_pid_for(1);
+    int a = m.allocate_pid_for(1, init);
+    int b = m.allocate_pid_for(1, init);
+    int a1 = m.allocate_pid_for(1, a);
+    int a2 = m.allocate_pid_for(1, a);
+    int a1x = m.allocate_pid_for(1, a1);
+    CHECK(m.parent_of(a1x) == a1 && m.parent_of(init) == -1, "parent links recorded");
+    CHECK(m.children(init) == std::vector<int>({b, a}), "children listed newest first");
+    CHECK(m.allocate_pid_for(1, 150) != -1 && m.parent_of(m.next_allocated(a1x + 1)) == -1,
+          "dead parent is not recorded");
+    m.release_pid(m.next_allocated(a1x + 1));
+
+    // Releasing a parent re-parents its children to the grandparent.
+    m.release_pid(a);
+    CHECK(m.parent_of(a1) == init && m.parent_of(a2) == init, "orphans adopted by grandparent");
+    CHECK(m.children(init).size() == 3 && m.children(a1) == std::vector<int>({a1x}), "subtrees stay intact");
+    m.release_pid(init);
+    CHECK(m.parent_of(a1) == -1 && m.parent_of(b) == -1, "orphans of a root become roots");
+
+    CHECK(m.reparent_children(a1, a2) == 1 && m.parent_of(a1x) == a2, "explicit re-parenting");
+    CHECK(m.reparent_children(a2, a1x) == -1, "re-parenting into own subtree is refused");
+    CHECK(m.reparent_children(a2, 199) == -1, "re-parenting under a dead pid is refused");
+
+    // Cascading release of a deep chain and a wide fan-out.
+    int root = m.allocate_pid_for(2);
+    int last = root;
+    for (int i = 0; i < 50; ++i) last = m.allocate_pid_for(2, last);
+    for (int i = 0; i < 20; ++i) m.allocate_pid_for(2, root);
+    CHECK(m.owned_count(2) == 71, "tree built");
+    CHECK(m.release_subtree(root) == 71 && m.owned_count(2) == 0 && !m.is_allocated(last),
+          "release_subtree frees every descendant");
+    CHECK(m.release_subtree(root) == 0, "release_subtree on a free pid is a no-op");
+    CHECK(m.release_subtree(a2) == 2 && !m.is_allocated(a1x) && m.is_allocated(a1), "subtree only");
+
+    // Reused slots start with no links.
+    int fresh = m.allocate_pid();
+    CHECK(m.children(fresh).empty() && m.parent_of(fresh) == -1, "reused slot has clean links");
+
+    std::cout << "  ✓ parent links, orphan re-parenting and cascading release\n\n";
+}
+
+static void zombie_tests() {
+    std::cout << "[Zombie Tests]\n";
+
+    PIDManager m(1, 64);
+    m.allocate_map();
+    m.enable_metadata();
+    int parent = m.allocate_pid_for(1);
+    int kid = m.allocate_pid_for(1, parent);
+    int grandkid = m.allocate_pid_for(1, kid);
+    CHECK(m.exit_pid(kid) == 1 && m.is_zombie(kid) && m.is_allocated(kid), "exited pid becomes a zombie");
+    CHECK(m.exit_pid(kid) == -1 && m.exit_pid(60) == -1, "only live pids can exit");
+    CHECK(m.parent_of(grandkid) == parent, "children are re-parented at exit");
+    CHECK(m.allocate_pid_for(1, kid) != -1 && m.parent_of(m.next_allocated(grandkid + 1)) == -1,
+          "a zombie cannot become a parent");
+    m.release_pid(m.next_allocated(grandkid + 1));
+
+    // Allocation skips zombies until they are reaped.
+    std::vector<int> got;
+    for (int pid = m.allocate_pid(); pid != -1; pid = m.allocate_pid()) got.push_back(pid);
+    CHECK(std::find(got.begin(), got.end(), kid) == got.end() && got.size() == 61, "zombie slot is skipped");
+    for (std::size_t i = 0; i < got.size(); i += 2) m.exit_pid(got[i]);
+    CHECK(m.zombie_count() == 32 && m.zombies().size() == 32 && m.zombies()[0] == kid, "zombies enumerated in order");
+
+    CHECK(m.reap_child(parent) == kid && !m.is_allocated(kid) && m.reap_child(parent) == -1, "reap_child waits on a child");
+    CHECK(m.reap(got[0]) == 1 && m.reap(got[0]) == -1 && m.reap(got[1]) == -1, "reap frees zombies only");
+    m.release_pid(got[2]);
+    CHECK(!m.is_zombie(got[2]) && m.zombie_count() == 29, "release_pid reaps a zombie too");
+    CHECK(m.allocate_pid() == kid, "reaped pid is reused");
+    for (int pid : got) m.release_pid(pid);
+    m.exit_pid(parent);
+    m.release_all(1);
+    CHECK(m.zombie_count() == 0 && m.zombies().empty() && m.next_allocated(0) == kid, "release_all reaps zombies");
+
+    // Zombies work without metadata, and with the other engines.
+    SparsePIDManager s(0, 200000);
+    s.allocate_map();
+    for (int i = 0; i < 1000; ++i) s.allocate_pid();
+    s.exit_pid(7);
+    s.exit_pid(999);
+    CHECK(s.zombies() == std::vector<int>({7, 999}) && s.reap_child(0) == -1, "sparse engine zombies");
+    CHECK(s.allocate_map() == 1 && s.zombie_count() == 0 && !s.is_zombie(7), "allocate_map clears zombies");
+    std::cout << "  ✓ exit / reap / zombie enumeration\n\n";
+}
+
+static void limit_group_tests() {
+    std::cout << "[Limit Group Tests]\n";
+
+    // 1) Hierarchical charging on its own.
+    {
+        PIDLimitGroups g;
+        int pod = g.create(0, 5);
+        int a = g.create(pod, 3);
+        int b = g.create(pod);
+        CHECK(g.create(99) == -1 && g.create(pod, -1) == -1, "bad groups are refused");
+        CHECK(g.try_charge(a, 3) && !g.try_charge(a) && g.events(a) == 1, "child limit enforced");
+        CHECK(g.try_charge(b, 2) && !g.try_charge(b) && g.events(pod) == 1 && g.usage(b) == 2,
+              "ancestor limit enforced, partial charge undone");
+        CHECK(g.usage(pod) == 5 && g.usage(0) == 5, "usage propagates to the root");
+        g.uncharge(a, 3);
+        CHECK(g.usage(pod) == 2 && g.usage(0) == 2 && g.try_charge(b), "uncharge propagates");
+        CHECK(g.set_limit(pod, 1) == 1 && g.usage(pod) == 3 && !g.try_charge(a), "lowered limit keeps usage");
+    }
+
+    // 2) Attached to a manager: every release path uncharges.
+    {
+        PIDLimitGroups g;
+        int box = g.create(0, 3);
+        int web = g.create(box, 2);
+        PIDManager m(1, 1000);
+        m.allocate_map();
+        CHECK(m.allocate_pid_in(web) == -1, "no limits attached");
+        m.enable_metadata();
+        CHECK(m.attach_limits(&g) == 1, "attach");
+        int p = m.allocate_pid_in(web, 7);
+        int c1 = m.allocate_pid_in(web, 7, p);
+        int c2 = m.allocate_pid_in(box, 7, p);
+        CHECK(m.allocate_pid_in(web) == -1 && m.allocate_pid_in(box) == -1 && m.allocate_pid_in(0) != -1,
+              "allocation rejected at the limit");
+        CHECK(m.group_of(c2) == box && m.group_of(1000) == -1, "group_of");
+        m.release_pid(c1);
+        CHECK(g.usage(web) == 1 && g.usage(box) == 2, "release_pid uncharges");
+        m.exit_pid(p);
+        CHECK(g.usage(box) == 2, "zombies stay charged");
+        m.reap(p);
+        m.release_all(7);
+        CHECK(g.usage(box) == 0 && g.usage(0) == 1, "reap and release_all uncharge");
+        CHECK(m.attach_limits(nullptr) == -1, "detach refused while charged");
+        m.resize(2000);
+        CHECK(m.allocate_pid_in(web) != -1, "limits survive a resize");
+        m.allocate_map();
+        CHECK(g.usage(0) == 0 && m.attach_limits(nullptr) == 1, "allocate_map uncharges everything");
+    }
+
+    // Regression: attach, then resize before allocate_map. The group table
+    // must cover the grown range up to its top slot.
+    {
+        PIDLimitGroups g;
+        int grp = g.create(0, 1);
+        PIDManager m(1, 100);
+        CHECK(m.attach_limits(&g) == 1 && m.resize(5000) == 1 && m.allocate_map() == 1, "attach, resize, allocate_map");
+        for (int i = 1; i < 5000; ++i) m.allocate_pid();
+        CHECK(m.allocate_pid_in(grp) == 5000 && m.group_of(5000) == grp, "top slot charged");
+        m.release_pid(5000);
+        CHECK(g.usage(grp) == 0, "and uncharged");
+    }
+
+    // 3) Lock-free counters: concurrent charging never overshoots a limit.
+    {
+        PIDLimitGroups g;
+        int top = g.create(0, 100);
+        int leaves[4];
+        for (int& l : leaves) l = g.create(top, 40);
+        std::vector<std::thread> workers;
+        std::atomic<bool> overshoot{false};
+        for (int t = 0; t < 4; ++t) {
+            workers.emplace_back([&, t] {
+                int held = 0;
+                for (int i = 0; i < 20000; ++i) {
+                    if ((i & 1) == 0 && g.try_charge(leaves[t])) ++held;
+                    else if (held > 0 && (i % 3) == 0) { g.uncharge(leaves[t]); --held; }
+                    if (g.usage(leaves[t]) > 40) overshoot = true;
+                }
+                g.uncharge(leaves[t], held);
+            });
+        }
+        for (std::thread& w : workers) w.join();
+        CHECK(!overshoot && g.usage(top) == 0 && g.usage(0) == 0, "concurrent charges balance");
+    }
+    std::cout << "  ✓ hierarchical pids.max charging\n\n";
+}
+
+static void protocol_tests() {
+    std::cout << "[Protocol Tests]\n";
+    namespace proto = pid_protocol;
+
+    // Frames split at every byte boundary decode the same.
+    std::vector<char> wire;
+    int rel[] = {5, 6, 70000};
+    proto::append(wire, proto::kAlloc, 4);
+    proto::append(wire, proto::kRelease, 3, rel);
+    proto::append(wire, proto::kDone, 0);
+    proto::Decoder dec;
+    proto::Header h{};
+    std::vector<int> pids;
+    std::vector<proto::Header> seen;
+    for (char byte : wire) {
+        dec.feed(&byte, 1);
+        while (dec.next(h, pids) == 1) seen.push_back(h);
+    }
+    CHECK(seen.size() == 3 && seen[0].op == proto::kAlloc && seen[0].count == 4 &&
+          seen[2].op == proto::kDone && dec.buffered() == 0, "byte-at-a-time decode");
+    dec.feed(wire.data(), wire.size());
+    CHECK(dec.next(h, pids) == 1 && dec.next(h, pids) == 1 && pids == std::vector<int>({5, 6, 70000}),
+          "release payload round-trips");
+
+    proto::Header bad{9, proto::kVersion, 1, 0};
+    proto::Decoder junk;
+    junk.feed(reinterpret_cast<const char*>(&bad), sizeof bad);
+    CHECK(junk.next(h, pids) == -1, "unknown opcode is rejected");
+    proto::Header big{proto::kRelease, proto::kVersion, static_cast<std::uint16_t>(proto::kMaxBatch + 1), 0};
+    junk = proto::Decoder();
+    junk.feed(reinterpret_cast<const char*>(&big), sizeof big);
+    CHECK(junk.next(h, pids) == -1, "oversized batch is rejected");
+    proto::Header v1{proto::kAlloc, 1, 1, 0};
+    junk = proto::Decoder();
+    junk.feed(reinterpret_cast<const char*>(&v1), sizeof v1);
+    CHECK(junk.next(h, pids) == -1, "another protocol version is rejected");
+
+    // Serving: batched grants, partial grants when low, owner-checked releases.
+    PIDManager m(1, 8);
+    m.allocate_map();
+    m.enable_metadata();
+    std::vector<char> out;
+    CHECK(proto::serve(m, 3, proto::Header{proto::kAlloc, proto::kVersion, 6, 1}, {}, out) == 1, "alloc served");
+    CHECK(proto::serve(m, 4, proto::Header{proto::kAlloc, proto::kVersion, 6, 1}, {}, out) == 1, "second alloc served");
+    proto::Decoder replies;
+    replies.feed(out.data(), out.size());
+    CHECK(replies.next(h, pids) == 1 && h.op == proto::kPids && h.id == 1 && pids.size() == 6 && m.owned_count(3) == 6,
+          "full grant in one frame, tagged with the request id");
+    std::vector<int> mine = pids;
+    CHECK(replies.next(h, pids) == 1 && pids.size() == 2 && m.free_count() == 0, "partial grant when low");
+    CHECK(proto::serve(m, 4, proto::Header{proto::kRelease, proto::kVersion, 6, 2}, mine, out) == 1 && m.owned_count(3) == 6,
+          "cannot release another client's pids");
+    proto::serve(m, 3, proto::Header{proto::kRelease, proto::kVersion, 6, 2}, mine, out);
+    CHECK(m.owned_count(3) == 0 && m.free_count() == 6, "owner releases in one frame");
+    CHECK(proto::serve(m, 3, proto::Header{proto::kDone, proto::kVersion, 0, 3}, {}, out) == 0 &&
+          proto::serve(m, 3, proto::Header{proto::kPids, proto::kVersion, 0, 4}, {}, out) == -1, "done / client-only ops");
+
+    // Over a real pipe: one write, one read.
+    int fds[2];
+    CHECK(pipe(fds) == 0, "pipe");
+    CHECK(proto::write_all(fds[1], wire.data(), wire.size()) == 1, "write_all");
+    close(fds[1]);
+    proto::Decoder fromPipe;
+    CHECK(fromPipe.read_from(fds[0]) == static_cast<ssize_t>(wire.size()) && fromPipe.read_from(fds[0]) == 0,
+          "one read gets the whole batch");
+    close(fds[0]);
+    int frames = 0;
+    while (fromPipe.next(h, pids) == 1) ++frames;
+    CHECK(frames == 3, "batch decoded");
+    std::cout << "  ✓ framed batch protocol\n\n";
+}
+
+// Reads every complete kPids frame available on fd (non-blocking) into `grants`.
+static std::size_t drain_replies(int fd, pid_protocol::Decoder& dec, std::vector<std::vector<int>>& grants) {
+    pid_protocol::Header h{};
+    std::vector<int> pids;
+    std::size_t frames = 0;
+    while (dec.read_from(fd) > 0) {
+    }
+    while (dec.next(h, pids) == 1) {
+        grants.push_back(pids);
+        ++frames;
+    }
+    return frames;
+}
+
+static void server_tests() {
+    std::cout << "[Server Tests]\n";
+    namespace proto = pid_protocol;
+
+    PIDManager m(0, (1 << 21) - 1);
+    m.allocate_map();
+    m.enable_metadata();
+    PIDServer server(m);
+
+    // Client A floods requests and never reads; client B is a normal client.
+    int a_req[2], a_rep[2], b_req[2], b_rep[2];
+    CHECK(pipe(a_req) == 0 && pipe(a_rep) == 0 && pipe(b_req) == 0 && pipe(b_rep) == 0, "pipes");
+    int a = server.add_client(a_req[0], a_rep[1]);
+    int b = server.add_client(b_req[0], b_rep[1]);
+    CHECK(a == 1 && b == 2 && server.client_count() == 2, "clients registered");
+    fcntl(a_rep[0], F_SETFL, O_NONBLOCK);
+    fcntl(b_rep[0], F_SETFL, O_NONBLOCK);
+
+    std::vector<char> flood;
+    for (int i = 0; i < 1000; ++i) proto::append(flood, proto::kAlloc, proto::kMaxBatch);
+    CHECK(proto::write_all(a_req[1], flood.data(), flood.size()) == 1, "flood queued");
+    for (int i = 0; i < 20 && server.poll_once(0) > 0; ++i) {
+    }
+    std::uint64_t stalled = server.frames_served();
+    CHECK(stalled < 1000 && server.poll_once(0) == 0, "a client that doesn't read is parked, not spun on");
+
+    std::vector<char> req;
+    proto::append(req, proto::kAlloc, 5);
+    CHECK(proto::write_all(b_req[1], req.data(), req.size()) == 1, "b request");
+    server.poll_once(100);
+    proto::Decoder bdec;
+    std::vector<std::vector<int>> bgot;
+    CHECK(drain_replies(b_rep[0], bdec, bgot) == 1 && bgot[0].size() == 5 && m.owned_count(2) == 5,
+          "other clients are served while one is stalled");
+
+    // A catches up: the server resumes its buffered requests.
+    proto::Decoder adec;
+    std::vector<std::vector<int>> agot;
+    for (int i = 0; i < 10000 && agot.size() < 1000; ++i) {
+        drain_replies(a_rep[0], adec, agot);
+        server.poll_once(0);
+    }
+    CHECK(agot.size() == 1000 && server.frames_served() == 1001 && m.owned_count(1) == 1000 * proto::kMaxBatch,
+          "stalled client finishes once it reads");
+
+    // Release and Done in one write; the server closes the connection.
+    req.clear();
+    proto::append(req, proto::kRelease, bgot[0].size(), bgot[0].data());
+    proto::append(req, proto::kDone, 0);
+    proto::write_all(b_req[1], req.data(), req.size());
+    server.poll_once(100);
+    CHECK(server.client_count() == 1 && m.owned_count(2) == 0, "done closes the client");
+    char byte;
+    CHECK(read(b_rep[0], &byte, 1) == 0, "reply pipe closed by the server");
+
+    // Hanging up without Done also disconnects; the PIDs stay with the owner.
+    close(a_req[1]);
+    server.poll_once(100);
+    CHECK(server.client_count() == 0 && server.run() == 1 && m.owned_count(1) > 0, "EOF disconnects");
+    CHECK(m.release_all(1) == 1000 * proto::kMaxBatch, "owner's pids reclaimed in bulk");
+    close(a_rep[0]);
+    close(b_req[1]);
+    close(b_rep[0]);
+    std::cout << "  ✓ epoll server, per-client batching and back-pressure\n\n";
+}
+
+static void seqpacket_tests() {
+    std::cout << "[SEQPACKET Transport Tests]\n";
+    namespace proto = pid_protocol;
+
+    PIDManager m(1, 5000);
+    m.allocate_map();
+    m.enable_metadata();
+    PIDServer server(m);
+    std::string path = "/tmp/pid_manager_test." + std::to_string(getpid()) + ".sock";
+    CHECK(server.listen_unix(path.c_str()) == 1 && server.listen_unix(path.c_str()) == -1, "listener");
+
+    int a = proto::connect_unix(path.c_str());
+    int b = proto::connect_unix(path.c_str());
+    CHECK(a != -1 && b != -1 && proto::connect_unix("/tmp/no/such/socket") == -1, "unrelated clients connect");
+    server.poll_once(100);
+    CHECK(server.clients_seen() == 2, "both accepted");
+
+    // 100 requests go out as 100 datagrams in two sendmmsg calls; one
+    // reply datagram comes back per kAlloc.
+    std::vector<char> batch;
+    for (int i = 0; i < 100; ++i) proto::append(batch, proto::kAlloc, 10);
+    CHECK(proto::send_frames(a, batch) == 1, "batched send");
+    for (int i = 0; i < 20 && server.frames_served() < 100; ++i) server.poll_once(100);
+    proto::Decoder dec;
+    proto::Header h{};
+    std::vector<int> pids;
+    std::vector<int> all;
+    for (int i = 0; i < 100; ++i) {
+        CHECK(dec.read_from(a, proto::kMaxFrame) == static_cast<ssize_t>(sizeof(proto::Header) + 40), "one frame per datagram");
+        CHECK(dec.next(h, pids) == 1 && h.op == proto::kPids && pids.size() == 10, "reply frame");
+        all.insert(all.end(), pids.begin(), pids.end());
+    }
+    CHECK(m.owned_count(1) == 1000, "grants charged to the socket client");
+
+    std::vector<char> rel;
+    for (std::size_t i = 0; i < all.size(); i += proto::kMaxBatch) {
+        std::size_t n = std::min<std::size_t>(proto::kMaxBatch, all.size() - i);
+        proto::append(rel, proto::kRelease, n, &all[i]);
+    }
+    proto::append(rel, proto::kDone, 0);
+    CHECK(proto::send_frames(a, rel) == 1, "release and done");
+    for (int i = 0; i < 20 && server.client_count() == 2; ++i) server.poll_once(100);
+    CHECK(m.owned_count(1) == 0 && server.client_count() == 1, "released, then disconnected on Done");
+    char byte;
+    CHECK(read(a, &byte, 1) == 0, "server closed its end");
+    close(a);
+
+    // Two frames glued into one datagram break the framing rule.
+    std::vector<char> glued;
+    proto::append(glued, proto::kAlloc, 1);
+    proto::append(glued, proto::kAlloc, 1);
+    CHECK(write(b, glued.data(), glued.size()) == static_cast<ssize_t>(glued.size()), "glued write");
+    for (int i = 0; i < 20 && server.client_count() == 1; ++i) server.poll_once(100);
+    CHECK(server.client_count() == 0 && m.owned_count(2) == 0, "malformed datagram drops the client");
+    close(b);
+
+    // A socketpair is detected as SOCK_SEQPACKET too.
+    int sp[2];
+    CHECK(socketpair(AF_UNIX, SOCK_SEQPACKET, 0, sp) == 0, "socketpair");
+    server.add_client(sp[0], sp[0]);
+    std::vector<char> one;
+    proto::append(one, proto::kAlloc, 2);
+    proto::send_frames(sp[1], one);
+    server.poll_once(100);
+    proto::Decoder spdec;
+    CHECK(spdec.read_from(sp[1]) == 16 && spdec.next(h, pids) == 1 && pids.size() == 2, "socketpair client");
+    close(sp[1]);
+    server.poll_once(100);
+    CHECK(server.client_count() == 0, "peer close is an EOF");
+    server.close_listener();
+    CHECK(access(path.c_str(), F_OK) == -1, "socket file removed");
+    std::cout << "  ✓ AF_UNIX SOCK_SEQPACKET listener with recvmmsg/sendmmsg\n\n";
+}
+
+static void shm_ring_tests() {
+    std::cout << "[Shared-Memory Ring Tests]\n";
+    namespace proto = pid_protocol;
+
+    // 1) Ring wrap-around with frames of varying size, and full-ring refusal.
+    {
+        pid_shm::Region region(1, 8192);
+        pid_shm::Ring& ring = region.requests(0);
+        std::vector<char> f;
+        std::vector<int> payload(300);
+        proto::Header h{};
+        std::vector<int> got;
+        for (int i = 0; i < 500; ++i) {
+            f.clear();
+            std::size_t n = static_cast<std::size_t>(i * 7 % 300);
+            for (std::size_t k = 0; k < n; ++k) payload[k] = i * 1000 + static_cast<int>(k);
+            proto::append(f, proto::kRelease, n, payload.data());
+            CHECK(ring.push(f.data(), f.size()), "push");
+            CHECK(ring.pop(h, got) == 1 && got.size() == n && (n == 0 || got[n - 1] == i * 1000 + static_cast<int>(n) - 1),
+                  "pop returns the frame intact across the wrap");
+        }
+        CHECK(ring.pop(h, got) == 0 && ring.empty(), "empty ring");
+        std::vector<char> big;
+        proto::append(big, proto::kRelease, 1000, std::vector<int>(1000, 1).data());
+        CHECK(ring.push(big.data(), big.size()) && ring.push(big.data(), big.size()) && !ring.push(big.data(), big.size()),
+              "full ring refuses a frame instead of splitting it");
+        bool threw = false;
+        try { pid_shm::Region bad(1, 1000); } catch (const std::invalid_argument&) { threw = true; }
+        CHECK(threw, "ring size must be a power of two >= one frame");
+    }
+
+    // 2) Client threads against the poller, with futex sleep/wake on both sides.
+    {
+        PIDManager m(1, 100000);
+        m.allocate_map();
+        m.enable_metadata();
+        pid_shm::Region region(3, 1u << 14);
+        PIDRingServer server(m, region, 10);
+        std::atomic<int> bad{0};
+        std::vector<std::thread> clients;
+        for (unsigned c = 0; c < 3; ++c) {
+            clients.emplace_back([&, c] {
+                pid_shm::Client client(region, c);
+                proto::Header h{};
+                std::vector<int> pids, held;
+                std::vector<char> out;
+                for (int round = 0; round < 300; ++round) {
+                    out.clear();
+                    proto::append(out, proto::kAlloc, 4);
+                    proto::append(out, proto::kAlloc, 3);
+                    client.send(out);
+                    for (int k = 0; k < 2; ++k) {
+                        if (client.receive(h, pids) != 1 || h.op != proto::kPids) ++bad;
+                        held.insert(held.end(), pids.begin(), pids.end());
+                    }
+                    if (round % 50 == 49) usleep(2000); // let the server fall asleep
+                }
+                if (held.size() != 300 * 7) ++bad;
+                out.clear();
+                for (std::size_t i = 0; i < held.size(); i += proto::kMaxBatch) {
+                    proto::append(out, proto::kRelease, std::min<std::size_t>(proto::kMaxBatch, held.size() - i), &held[i]);
+                }
+                proto::append(out, proto::kDone, 0);
+                client.send(out);
+            });
+        }
+        server.run();
+        for (std::thread& t : clients) t.join();
+        CHECK(bad == 0 && server.frames_served() == 3 * (600 + 3 + 1), "every frame served");
+        CHECK(m.owned_count(10) == 0 && m.owned_count(12) == 0 && m.free_count() == m.capacity(), "all released");
+    }
+
+    // 3) Across fork: the child inherits the mapping.
+    {
+        PIDManager m(1, 1000);
+        m.allocate_map();
+        m.enable_metadata();
+        pid_shm::Region region(1);
+        std::cout.flush();
+        pid_t child = fork();
+        CHECK(child >= 0, "fork");
+        if (child == 0) {
+            pid_shm::Client client(region, 0);
+            std::vector<char> out;
+            proto::append(out, proto::kAlloc, 5);
+            client.send(out);
+            proto::Header h{};
+            std::vector<int> pids;
+            int ok = client.receive(h, pids, 5000) == 1 && pids.size() == 5;
+            out.clear();
+            proto::append(out, proto::kDone, 0);
+            client.send(out);
+            _exit(ok ? 0 : 1);
+        }
+        PIDRingServer server(m, region);
+        while (!server.all_done()) server.poll_once(100);
+        int status = 0;
+        waitpid(child, &status, 0);
+        CHECK(WIFEXITED(status) && WEXITSTATUS(status) == 0 && m.owned_count(1) == 5, "forked ring client");
+    }
+
+    // 4) A client that dies without Done and a slot nobody attaches to
+    // don't hold run() up, and the dead client's PIDs are freed.
+    {
+        PIDManager m(1, 1000);
+        m.allocate_map();
+        m.enable_metadata();
+        pid_shm::Region region(2);
+        std::cout.flush();
+        pid_t child = fork();
+        CHECK(child >= 0, "fork");
+        if (child == 0) {
+            pid_shm::Client client(region, 0);
+            std::vector<char> out;
+            proto::append(out, proto::kAlloc, 9);
+            client.send(out);
+            proto::Header h{};
+            std::vector<int> pids;
+            client.receive(h, pids, 5000);
+            _exit(0); // crashes holding 9 PIDs
+        }
+        PIDRingServer server(m, region, 3);
+        server.run(1000);
+        waitpid(child, nullptr, 0);
+        CHECK(server.all_done() && server.clients_lost() == 1 && server.released_on_exit() == 9, "exit counts as Done");
+        CHECK(m.owned_count(3) == 0 && m.free_count() == m.capacity(), "dead client's PIDs freed");
+        bool threw = false;
+        try { pid_shm::Client late(region, 1); } catch (const std::runtime_error&) { threw = true; }
+        CHECK(threw, "an unattached slot is closed after the attach deadline");
+    }
+
+    // 5) A second process refused a slot can't pass for its client: the
+    // server watches the process that attached, so the refused one exiting
+    // neither closes the slot nor frees the client's PIDs.
+    {
+        PIDManager m(1, 1000);
+        m.allocate_map();
+        m.enable_metadata();
+        pid_shm::Region region(1);
+        int ready[2];
+        CHECK(pipe(ready) == 0, "pipe");
+        std::cout.flush();
+        pid_t real = fork();
+        CHECK(real >= 0, "fork");
+        if (real == 0) {
+            pid_shm::Client client(region, 0);
+            char byte = 1;
+            if (write(ready[1], &byte, 1) != 1) _exit(2);
+            std::vector<char> out;
+            proto::append(out, proto::kAlloc, 9);
+            client.send(out);
+            proto::Header h{};
+            std::vector<int> pids;
+            if (client.receive(h, pids, 5000) != 1 || pids.size() != 9) _exit(1);
+            out.clear();
+            proto::append(out, proto::kRelease, pids.size(), pids.data());
+            proto::append(out, proto::kDone, 0);
+            client.send(out);
+            _exit(0);
+        }
+        char byte;
+        CHECK(read(ready[0], &byte, 1) == 1, "client attached");
+        pid_t refused = fork();
+        CHECK(refused >= 0, "fork");
+        if (refused == 0) {
+            try { pid_shm::Client intruder(region, 0); } catch (const std::runtime_error&) { _exit(0); }
+            _exit(1);
+        }
+        int status = -1;
+        waitpid(refused, &status, 0);
+        CHECK(WIFEXITED(status) && WEXITSTATUS(status) == 0, "second attacher refused, and gone");
+        PIDRingServer server(m, region, 1);
+        server.run(1000);
+        waitpid(real, &status, 0);
+        CHECK(WIFEXITED(status) && WEXITSTATUS(status) == 0, "the attached client was served");
+        CHECK(server.clients_lost() == 0 && m.free_count() == m.capacity(), "slot kept, PIDs released by their client");
+        close(ready[0]);
+        close(ready[1]);
+    }
+    std::cout << "  ✓ SPSC rings in shared memory with futex wakeups\n\n";
+}
+
+static void uring_tests() {
+    std::cout << "[io_uring Server Tests]\n";
+    namespace proto = pid_protocol;
+
+    PIDManager m(1, 1000000);
+    m.allocate_map();
+    m.enable_metadata();
+    PIDUringServer* made = nullptr;
+    try {
+        made = new PIDUringServer(m, 64, 100);
+    } catch (const std::runtime_error&) {
+        std::cout << "  (io_uring unavailable here, skipped)\n\n";
+        return;
+    }
+    std::unique_ptr<PIDUringServer> server(made);
+
+    // 1) Many clients, several requests each: one round harvests all of
+    // them and the replies go out in the same few io_uring_enter calls.
+    const int kClients = 12;
+    std::vector<int> peers;
+    for (int i = 0; i < kClients; ++i) {
+        int sp[2];
+        CHECK(socketpair(AF_UNIX, i % 3 == 2 ? SOCK_STREAM : SOCK_SEQPACKET, 0, sp) == 0, "socketpair");
+        CHECK(server->add_client(sp[0]) == 100 + i, "owner ids start at first_owner");
+        fcntl(sp[1], F_SETFL, O_NONBLOCK);
+        peers.push_back(sp[1]);
+    }
+    int pfd[2];
+    CHECK(pipe(pfd) == 0 && server->add_client(pfd[0]) == -1, "pipes are refused");
+    close(pfd[0]);
+    close(pfd[1]);
+    for (int i = 0; i < kClients; ++i) {
+        std::vector<char> batch;
+        for (int k = 0; k < 20; ++k) proto::append(batch, proto::kAlloc, 3);
+        CHECK(i % 3 == 2 ? proto::write_all(peers[i], batch.data(), batch.size()) == 1 : proto::send_frames(peers[i], batch) == 1,
+              "requests sent");
+    }
+    std::uint64_t before = server->enters();
+    for (int i = 0; i < 100 && server->frames_served() < kClients * 20; ++i) server->poll_once(100);
+    CHECK(server->frames_served() == kClients * 20, "every request served");
+    CHECK(server->enters() - before < kClients * 20 / 4, "requests from many clients share each io_uring_enter");
+
+    std::vector<std::vector<int>> held(kClients);
+    proto::Header h{};
+    std::vector<int> pids;
+    for (int i = 0; i < kClients; ++i) {
+        proto::Decoder dec;
+        int got = 0;
+        while (got < 20) {
+            int r;
+            while (got < 20 && (r = dec.next(h, pids)) == 1) {
+                CHECK(h.op == proto::kPids && pids.size() == 3, "reply frame");
+                held[i].insert(held[i].end(), pids.begin(), pids.end());
+                ++got;
+            }
+            if (got < 20) {
+                ssize_t n = dec.read_from(peers[i], i % 3 == 2 ? 64 * 1024 : proto::kMaxFrame);
+                CHECK(n > 0 || errno == EAGAIN, "reply arrives");
+                CHECK(n <= 0 || i % 3 == 2 || n == static_cast<ssize_t>(sizeof(proto::Header) + 12), "one datagram per reply");
+                if (n < 0) server->poll_once(10); // the rest of a long reply chain
+            }
+        }
+        CHECK(m.owned_count(100 + static_cast<std::uint32_t>(i)) == 60, "grants charged to the client");
+    }
+
+    // 2) Release and Done: each client is closed once its writes are done.
+    for (int i = 0; i < kClients; ++i) {
+        std::vector<char> out;
+        proto::append(out, proto::kRelease, held[i].size(), held[i].data());
+        proto::append(out, proto::kDone, 0);
+        proto::append(out, proto::kAlloc, 1); // after Done: ignored
+        CHECK(i % 3 == 2 ? proto::write_all(peers[i], out.data(), out.size()) == 1 : proto::send_frames(peers[i], out) == 1,
+              "release sent");
+    }
+    for (int i = 0; i < 100 && server->client_count() > 0; ++i) server->poll_once(100);
+    CHECK(server->client_count() == 0 && m.free_count() == m.capacity(), "all released, all closed");
+    char byte;
+    for (int fd : peers) {
+        CHECK(read(fd, &byte, 1) == 0, "server closed its end");
+        close(fd);
+    }
+
+    // 3) A client that never reads: its receive is cancelled at the reply
+    // limit, others keep being served, and it resumes once it drains.
+    {
+        int a[2], b[2];
+        CHECK(socketpair(AF_UNIX, SOCK_STREAM, 0, a) == 0 && socketpair(AF_UNIX, SOCK_SEQPACKET, 0, b) == 0, "pairs");
+        int flags = fcntl(a[1], F_GETFL);
+        fcntl(a[1], F_SETFL, flags | O_NONBLOCK);
+        std::uint32_t ida = static_cast<std::uint32_t>(server->add_client(a[0]));
+        std::uint32_t idb = static_cast<std::uint32_t>(server->add_client(b[0]));
+        std::vector<char> flood;
+        for (int k = 0; k < 600; ++k) proto::append(flood, proto::kAlloc, proto::kMaxBatch);
+        std::size_t off = 0;
+        for (int i = 0; i < 50; ++i) { // the server reads while we write
+            while (off < flood.size()) {
+                ssize_t w = write(a[1], &flood[off], flood.size() - off);
+                if (w <= 0) break;
+                off += static_cast<std::size_t>(w);
+            }
+            server->poll_once(10);
+        }
+        CHECK(off == flood.size(), "flood written");
+        std::uint64_t stalled = server->frames_served();
+        CHECK(stalled < kClients * 22 + 600, "the silent client is held back");
+        std::vector<char> one;
+        proto::append(one, proto::kAlloc, 2);
+        proto::send_frames(b[1], one);
+        for (int i = 0; i < 20 && m.owned_count(idb) == 0; ++i) server->poll_once(100);
+        CHECK(m.owned_count(idb) == 2, "other clients are served while one is stalled");
+        proto::Decoder dec;
+        std::size_t replies = 0;
+        for (int i = 0; i < 100000 && replies < 600; ++i) {
+            while (dec.read_from(a[1]) > 0) {
+            }
+            while (dec.next(h, pids) == 1) ++replies;
+            server->poll_once(0);
+        }
+        CHECK(replies == 600 && m.owned_count(ida) == 600 * proto::kMaxBatch, "stalled client finishes once it reads");
+        close(a[1]);
+        close(b[1]);
+        for (int i = 0; i < 20 && server->client_count() > 0; ++i) server->poll_once(100);
+        CHECK(server->client_count() == 0, "peer close is an EOF");
+        m.release_all(ida);
+        m.release_all(idb);
+    }
+
+    // 4) A stream client that hangs up with replies still pending: the
+    // sends fail with EPIPE, not SIGPIPE (this binary doesn't ignore it),
+    // and the client is closed.
+    {
+        int sp[2];
+        CHECK(socketpair(AF_UNIX, SOCK_STREAM, 0, sp) == 0, "pair");
+        std::uint32_t id = static_cast<std::uint32_t>(server->add_client(sp[0]));
+        std::vector<char> burst;
+        for (int k = 0; k < 200; ++k) proto::append(burst, proto::kAlloc, 1);
+        CHECK(proto::write_all(sp[1], burst.data(), burst.size()) == 1, "burst written");
+        close(sp[1]);
+        for (int i = 0; i < 20 && server->client_count() > 0; ++i) server->poll_once(100);
+        CHECK(server->client_count() == 0, "hung-up client closed, server alive");
+        m.release_all(id);
+    }
+
+    // 5) The listener hands accepted sockets to the same ring.
+    std::string path = "/tmp/pid_manager_uring." + std::to_string(getpid()) + ".sock";
+    CHECK(server->listen_unix(path.c_str()) == 1, "listener");
+    int c = proto::connect_unix(path.c_str());
+    CHECK(c != -1, "connect");
+    std::vector<char> req;
+    proto::append(req, proto::kAlloc, 4);
+    proto::send_frames(c, req);
+    proto::Decoder cdec;
+    std::uint64_t served = server->frames_served();
+    for (int i = 0; i < 20 && server->frames_served() == served; ++i) server->poll_once(100);
+    CHECK(cdec.read_from(c, proto::kMaxFrame) == 24 && cdec.next(h, pids) == 1 && pids.size() == 4, "accepted client served");
+    server->close_listener();
+    CHECK(access(path.c_str(), F_OK) == -1, "socket file removed");
+    close(c);
+    for (int i = 0; i < 20 && server->client_count() > 0; ++i) server->poll_once(100);
+    CHECK(server->client_count() == 0, "all clients gone");
+    std::cout << "  ✓ io_uring multishot receives, linked sends, no SIGPIPE from a hung-up client\n\n";
+}
+
+static void pipeline_tests() {
+    std::cout << "[Pipelining Tests]\n";
+    namespace proto = pid_protocol;
+
+    PIDManager m(1, 100000);
+    m.allocate_map();
+    m.enable_metadata();
+    PIDServer server(m);
+    int sp[2];
+    CHECK(socketpair(AF_UNIX, SOCK_SEQPACKET, 0, sp) == 0, "socketpair");
+    CHECK(server.add_client(sp[0], sp[0]) == 1, "client");
+    fcntl(sp[1], F_SETFL, O_NONBLOCK);
+
+    // 300 requests in flight at once, ids in no particular order, each
+    // asking for a different count; releases stream out as grants come in.
+    std::vector<std::uint32_t> ids(300);
+    for (std::uint32_t i = 0; i < ids.size(); ++i) ids[i] = 1000 + i * 7919 % 300;
+    std::map<std::uint32_t, std::size_t> outstanding; // id -> PIDs asked for
+    std::vector<char> out;
+    std::size_t next = 0;
+    proto::Decoder dec;
+    proto::Header h{};
+    std::vector<int> pids;
+    std::unordered_set<int> live;
+    std::uint32_t release_id = 5000;
+    for (int i = 0; i < 1000 && (next < ids.size() || !outstanding.empty()); ++i) {
+        out.clear();
+        for (std::size_t k = 0; k < 60 && next < ids.size(); ++k, ++next) { // under the socket's buffer
+            outstanding[ids[next]] = ids[next] % 5 + 1;
+            proto::append(out, proto::kAlloc, ids[next] % 5 + 1, nullptr, ids[next]);
+        }
+        CHECK(out.empty() || proto::send_frames(sp[1], out) == 1, "requests streamed without waiting");
+        server.poll_once(10);
+        std::vector<int> done;
+        while (dec.read_from(sp[1], proto::kMaxFrame) > 0) {
+            CHECK(dec.next(h, pids) == 1 && h.op == proto::kPids && h.version == proto::kVersion, "reply frame");
+            auto it = outstanding.find(h.id);
+            CHECK(it != outstanding.end() && it->second == pids.size(), "reply matches its request by id");
+            outstanding.erase(it);
+            for (int pid : pids) CHECK(live.insert(pid).second, "no PID granted twice while held");
+            done.insert(done.end(), pids.begin(), pids.end());
+        }
+        if (done.empty()) continue;
+        out.clear();
+        proto::append(out, proto::kRelease, done.size(), done.data(), release_id++);
+        CHECK(proto::send_frames(sp[1], out) == 1, "release streamed while requests are in flight");
+        for (int pid : done) live.erase(pid);
+    }
+    CHECK(next == ids.size() && outstanding.empty(), "every request answered");
+    out.clear();
+    proto::append(out, proto::kDone, 0, nullptr, release_id);
+    proto::send_frames(sp[1], out);
+    for (int i = 0; i < 20 && server.client_count() > 0; ++i) server.poll_once(10);
+    CHECK(server.client_count() == 0 && m.owned_count(1) == 0, "all released before Done");
+    close(sp[1]);
+    std::cout << "  ✓ request ids, many requests in flight, replies matched by id\n\n";
+}
+
+static void client_tests() {
+    std::cout << "[Client Tests]\n";
+
+    // 1) A fast allocator: the block grows to the ceiling and almost every
+    // allocate is served from the local pool.
+    {
+        PIDManager m(1, 100000);
+        m.allocate_map();
+        m.enable_metadata();
+        PIDServer server(m);
+        int sp[2];
+        CHECK(socketpair(AF_UNIX, SOCK_SEQPACKET, 0, sp) == 0 && server.add_client(sp[0], sp[0]) == 1, "client");
+        std::thread serving([&] { server.run(); });
+        PIDClient client(sp[1], sp[1]);
+        std::vector<int> got;
+        std::unordered_set<int> unique;
+        for (int i = 0; i < 50000; ++i) {
+            int pid = client.allocate();
+            if (pid == -1 || !unique.insert(pid).second) break;
+            got.push_back(pid);
+        }
+        CHECK(got.size() == 50000, "every allocation served, no PID twice");
+        CHECK(client.block_size() == PIDClient::kMaxBlock, "block grows with the allocation rate, up to the ceiling");
+        CHECK(client.refills() < 50000 / PIDClient::kMinBlock && client.stalls() <= client.refills(),
+              "a syscall per block, not per PID");
+        for (int pid : got) CHECK(client.release(pid) == 1, "release is local");
+        CHECK(client.pooled() <= 2 * client.block_size(), "excess goes back to the server in bulk");
+        std::size_t reused = 0;
+        std::uint64_t refills = client.refills();
+        for (int i = 0; i < 100; ++i) {
+            int pid = client.allocate();
+            reused += unique.count(pid);
+            client.release(pid);
+        }
+        CHECK(reused == 100 && client.refills() == refills, "released PIDs are reused locally");
+        CHECK(client.finish() == 1, "finish");
+        serving.join();
+        CHECK(m.owned_count(1) == 0 && m.free_count() == m.capacity(), "finish returns the pool");
+        close(sp[1]);
+    }
+
+    // 2) A slow allocator keeps small blocks; exhaustion shows up as -1.
+    {
+        PIDManager m(1, 40);
+        m.allocate_map();
+        m.enable_metadata();
+        PIDServer server(m);
+        int req[2], rep[2];
+        CHECK(pipe(req) == 0 && pipe(rep) == 0 && server.add_client(req[0], rep[1]) == 1, "pipe client");
+        std::thread serving([&] { server.run(); });
+        PIDClient client(req[1], rep[0]);
+        std::vector<int> got;
+        for (int i = 0; i < 12; ++i) {
+            got.push_back(client.allocate());
+            usleep(2000);
+        }
+        CHECK(client.block_size() == PIDClient::kMinBlock, "block stays small at a low rate");
+        int pid;
+        while ((pid = client.allocate()) != -1) got.push_back(pid);
+        CHECK(got.size() == 40 && std::count(got.begin(), got.end(), -1) == 0, "the whole range, then -1");
+        for (int p : got) client.release(p);
+        CHECK(client.finish() == 1, "finish");
+        serving.join();
+        CHECK(m.free_count() == 40, "all returned");
+        close(req[1]);
+        close(rep[0]);
+    }
+
+    // 3) A short burst is not a rate: a client that takes a few PIDs at once
+    // keeps the smallest block instead of leasing a large share of the range.
+    {
+        PIDManager m(100, 1000);
+        m.allocate_map();
+        m.enable_metadata();
+        PIDServer server(m);
+        int sp[2];
+        CHECK(socketpair(AF_UNIX, SOCK_SEQPACKET, 0, sp) == 0 && server.add_client(sp[0], sp[0]) == 1, "client");
+        std::thread serving([&] { server.run(); });
+        PIDClient client(sp[1], sp[1]);
+        std::vector<int> got;
+        for (int i = 0; i < 6; ++i) got.push_back(client.allocate());
+        CHECK(std::count(got.begin(), got.end(), -1) == 0, "burst served");
+        CHECK(client.block_size() == PIDClient::kMinBlock, "block stays at the minimum after a burst");
+        CHECK(client.pooled() + got.size() <= 2 * PIDClient::kMinBlock, "no more than two small blocks leased");
+        for (int p : got) client.release(p);
+        CHECK(client.finish() == 1, "finish");
+        serving.join();
+        CHECK(m.free_count() == m.capacity(), "all returned");
+        close(sp[1]);
+    }
+    std::cout << "  ✓ PIDClient prefetches adaptive blocks and reuses PIDs locally\n\n";
+}
+
+static void push_tests() {
+    std::cout << "[Push Tests]\n";
+    namespace proto = pid_protocol;
+
+    // 1) A stash raced by a taker and a pusher/reclaimer: every PID ends up
+    // in exactly one place.
+    {
+        pid_shm::Region region(1);
+        pid_shm::Stash& stash = region.slot(0).stash;
+        std::vector<int> big(pid_shm::Stash::kSize + 10, 7);
+        CHECK(stash.push(big.data(), big.size()) == pid_shm::Stash::kSize, "stash is bounded");
+        std::vector<int> back;
+        stash.reclaim(back);
+        CHECK(back.size() == pid_shm::Stash::kSize && stash.level() == 0 && stash.take() == -1, "reclaim empties it");
+
+        std::atomic<bool> stop{false};
+        std::vector<int> taken;
+        std::thread taker([&] {
+            while (!stop.load()) {
+                int pid = stash.take();
+                if (pid != -1) taken.push_back(pid);
+            }
+        });
+        std::vector<int> reclaimed;
+        int next = 0;
+        for (int round = 0; round < 20000; ++round) {
+            int batch[8];
+            for (int& b : batch) b = next++;
+            next -= 8 - static_cast<int>(stash.push(batch, 8));
+            if (round % 7 == 0) stash.reclaim(reclaimed);
+        }
+        stop = true;
+        taker.join();
+        stash.reclaim(reclaimed);
+        std::vector<int> all(taken);
+        all.insert(all.end(), reclaimed.begin(), reclaimed.end());
+        std::sort(all.begin(), all.end());
+        CHECK(static_cast<int>(all.size()) == next && std::adjacent_find(all.begin(), all.end()) == all.end() &&
+              (all.empty() || (all.front() == 0 && all.back() == next - 1)), "no PID lost or handed out twice");
+    }
+
+    // 2) A hungry client mostly takes pushed PIDs; once it idles, its
+    // stash is reclaimed.
+    {
+        PIDManager m(1, 200000);
+        m.allocate_map();
+        m.enable_metadata();
+        pid_shm::Region region(1);
+        PIDRingServer server(m, region, 7);
+        server.enable_push(256, 50);
+        std::atomic<int> from_push{0}, from_request{0}, bad{0};
+        std::atomic<std::size_t> left_after_idle{1};
+        std::thread client_thread([&] {
+            pid_shm::Client client(region, 0);
+            proto::Header h{};
+            std::vector<int> pids, held;
+            std::vector<char> out;
+            std::uint32_t id = 1;
+            while (held.size() < 40000) {
+                int pid = client.take_pushed();
+                if (pid != -1) {
+                    held.push_back(pid);
+                    ++from_push;
+                    continue;
+                }
+                out.clear();
+                proto::append(out, proto::kAlloc, 4, nullptr, id++);
+                client.send(out);
+                if (client.receive(h, pids, 5000) != 1) ++bad;
+                held.insert(held.end(), pids.begin(), pids.end());
+                from_request += static_cast<int>(pids.size());
+            }
+            usleep(300000); // idle: the server takes back what it pushed
+            left_after_idle = region.slot(0).stash.level();
+            std::sort(held.begin(), held.end());
+            if (std::adjacent_find(held.begin(), held.end()) != held.end()) ++bad;
+            out.clear();
+            for (std::size_t i = 0; i < held.size(); i += proto::kMaxBatch) {
+                proto::append(out, proto::kRelease, std::min<std::size_t>(proto::kMaxBatch, held.size() - i), &held[i], id++);
+            }
+            proto::append(out, proto::kDone, 0, nullptr, id);
+            client.send(out);
+        });
+        server.run();
+        client_thread.join();
+        CHECK(bad == 0, "no PID handed out twice");
+        CHECK(from_push > from_request, "most PIDs arrive before they are asked for");
+        CHECK(server.pushed() > 0 && server.reclaimed() > 0 && left_after_idle == 0, "an idle stash is reclaimed");
+        CHECK(m.owned_count(7) == 0 && m.free_count() == m.capacity(), "nothing leaks");
+    }
+    std::cout << "  ✓ rate-driven PID push into shared-memory stashes, capped and reclaimed on idle\n\n";
+}
+
+static void reclaim_tests() {
+    std::cout << "[Reclaim Tests]\n";
+
+    // Forks a client that takes `count` PIDs over `fd` and exits, without
+    // releasing them unless `clean`.
+    auto spawn = [](int fd, int other, int count, bool clean) {
+        pid_t child = fork();
+        if (child == 0) {
+            close(other);
+            PIDClient client(fd, fd);
+            for (int i = 0; i < count; ++i) client.allocate();
+            if (clean) client.finish();
+            _exit(0);
+        }
+        return child;
+    };
+    auto serve_until_exited = [](PIDServer& server) {
+        for (int i = 0; i < 1000 && (server.watching() > 0 || server.client_count() > 0); ++i) server.poll_once(100);
+    };
+
+    // 1) A client that dies holding PIDs: its pidfd fires and they all go
+    // back in one release_all; a clean client leaves nothing to reclaim.
+    {
+        PIDManager m(1, 1000);
+        m.allocate_map();
+        m.enable_metadata();
+        PIDServer server(m);
+        int a[2], b[2];
+        CHECK(socketpair(AF_UNIX, SOCK_SEQPACKET, 0, a) == 0 && socketpair(AF_UNIX, SOCK_SEQPACKET, 0, b) == 0, "sockets");
+        int crashed = server.add_client(a[0], a[0]);
+        int clean = server.add_client(b[0], b[0]);
+        pid_t c1 = spawn(a[1], a[0], 20, false);
+        pid_t c2 = spawn(b[1], b[0], 20, true);
+        close(a[1]);
+        close(b[1]);
+        CHECK(server.watch_process(crashed, c1) == 1 && server.watch_process(clean, c2) == 1, "watch");
+        CHECK(server.watch_process(crashed, c1) == -1 && server.watch_process(9, c1) == -1, "no double or unknown watch");
+        CHECK(server.watching() == 2, "both watched");
+        serve_until_exited(server);
+        CHECK(server.watching() == 0 && server.client_count() == 0, "both exits seen");
+        CHECK(m.owned_count(static_cast<std::uint32_t>(crashed)) == 0 && server.reclaimed() >= 20, "crashed client's PIDs reclaimed");
+        CHECK(m.free_count() == m.capacity(), "nothing leaked");
+        waitpid(c1, nullptr, 0);
+        waitpid(c2, nullptr, 0);
+    }
+
+    // 2) Accepted socket clients are watched through SO_PEERCRED.
+    {
+        PIDManager m(1, 1000);
+        m.allocate_map();
+        m.enable_metadata();
+        PIDServer server(m);
+        server.watch_peers(true);
+        std::string path = "/tmp/pid_reclaim_test." + std::to_string(getpid()) + ".sock";
+        CHECK(server.listen_unix(path.c_str()) == 1, "listen");
+        pid_t child = fork();
+        if (child == 0) {
+            int fd = pid_protocol::connect_unix(path.c_str());
+            PIDClient client(fd, fd);
+            for (int i = 0; i < 30; ++i) client.allocate();
+            _exit(0);
+        }
+        while (server.clients_seen() == 0) server.poll_once(100);
+        CHECK(server.watching() == 1, "peer watched on accept");
+        serve_until_exited(server);
+        CHECK(server.watching() == 0 && m.owned_count(1) == 0 && m.free_count() == m.capacity(), "peer's PIDs reclaimed");
+        waitpid(child, nullptr, 0);
+    }
+
+    // 3) The peer's pidfd comes from SO_PEERPIDFD where the kernel has it,
+    // else from SO_PEERCRED's PID.
+    {
+        int sp[2];
+        CHECK(socketpair(AF_UNIX, SOCK_SEQPACKET, 0, sp) == 0, "socketpair");
+        int pidfd = pid_protocol::peer_pidfd(sp[0]);
+        CHECK(pidfd != -1, "peer pidfd");
+        pollfd p{pidfd, POLLIN, 0};
+        CHECK(poll(&p, 1, 0) == 0, "a live peer's pidfd isn't readable");
+        close(pidfd);
+        close(sp[0]);
+        close(sp[1]);
+    }
+
+    // 4) The io_uring server watches pidfds with a poll in its own ring: a
+    // crashed pair client and a crashed accepted client are both reclaimed.
+    {
+        PIDManager m(1, 1000);
+        m.allocate_map();
+        m.enable_metadata();
+        PIDUringServer* made = nullptr;
+        try {
+            made = new PIDUringServer(m);
+        } catch (const std::runtime_error&) {
+            std::cout << "  (io_uring unavailable here, skipped)\n";
+        }
+        std::unique_ptr<PIDUringServer> server(made);
+        if (server) {
+            server->watch_peers(true);
+            std::string path = "/tmp/pid_reclaim_uring." + std::to_string(getpid()) + ".sock";
+            CHECK(server->listen_unix(path.c_str()) == 1, "listen");
+            int sp[2];
+            CHECK(socketpair(AF_UNIX, SOCK_SEQPACKET, 0, sp) == 0, "socketpair");
+            int paired = server->add_client(sp[0]);
+            pid_t c1 = spawn(sp[1], sp[0], 20, false);
+            close(sp[1]);
+            CHECK(server->watch_process(paired, c1) == 1 && server->watch_process(paired, c1) == -1, "watch once");
+            CHECK(server->watch_process(99, c1) == -1, "unknown client");
+            pid_t c2 = fork();
+            if (c2 == 0) {
+                int fd = pid_protocol::connect_unix(path.c_str());
+                PIDClient client(fd, fd);
+                for (int i = 0; i < 30; ++i) client.allocate();
+                _exit(0);
+            }
+            while (server->clients_seen() < 2) server->poll_once(100);
+            CHECK(server->watching() == 2, "pair and peer watched");
+            for (int i = 0; i < 1000 && (server->watching() > 0 || server->client_count() > 0); ++i) server->poll_once(100);
+            CHECK(server->watching() == 0 && server->client_count() == 0, "both exits seen");
+            CHECK(server->reclaimed() >= 50 && m.free_count() == m.capacity(), "crashed clients' PIDs reclaimed");
+            server->close_listener();
+            waitpid(c1, nullptr, 0);
+            waitpid(c2, nullptr, 0);
+        }
+    }
+
+    std::cout << "  ✓ PIDs of exited clients reclaimed through pidfds, in one bulk release\n\n";
+}
+
+static void log_tests() {
+    std::cout << "[Event Log Tests]\n";
+    auto lines = [](const std::string& s) { return static_cast<std::size_t>(std::count(s.begin(), s.end(), '\n')); };
+
+    // 1) Concurrent producers: every record is either written once or
+    // counted as dropped.
+    {
+        std::ostringstream out;
+        pid_log::EventLog events(out, 256);
+        std::vector<std::thread> producers;
+        for (std::uint32_t t = 0; t < 4; ++t) {
+            producers.emplace_back([&events, t] {
+                for (std::uint32_t i = 0; i < 20000; ++i) events.request(t + 1, i, pid_protocol::kRelease, 1);
+            });
+        }
+        for (std::thread& p : producers) p.join();
+        events.flush();
+        CHECK(events.logged() + events.dropped() == 80000, "every record written or dropped");
+        CHECK(lines(out.str()) == events.logged(), "one line per record");
+        CHECK(out.str().find("[Server] client 3 request 0 released 1\n") != std::string::npos || events.dropped() > 0,
+              "records formatted");
+    }
+
+    // 2) Sampling keeps one request in n; levels filter by kind.
+    {
+        std::ostringstream out;
+        pid_log::EventLog events(out);
+        events.set_sampling(10);
+        for (std::uint32_t i = 0; i < 1000; ++i) events.request(1, i, pid_protocol::kAlloc, 4, 4);
+        events.flush();
+        CHECK(lines(out.str()) == 100, "1 in 10 sampled");
+        out.str("");
+        events.set_level(pid_log::kInfo);
+        events.request(1, 1, pid_protocol::kDone, 0);
+        events.exited(1, 42);
+        events.flush();
+        CHECK(out.str() == "[Server] client 1 exited, reclaimed 42 PIDs\n", "kInfo drops requests, keeps exits");
+        events.set_level(pid_log::kOff);
+        events.exited(2, 1);
+        events.flush();
+        CHECK(lines(out.str()) == 1, "kOff logs nothing");
+    }
+
+    // 3) A PIDServer logs through it; the destructor writes out the rest.
+    {
+        std::ostringstream out;
+        {
+            pid_log::EventLog events(out);
+            PIDManager m(1, 100);
+            m.allocate_map();
+            m.enable_metadata();
+            PIDServer server(m);
+            server.set_log(&events);
+            int sp[2];
+            CHECK(socketpair(AF_UNIX, SOCK_SEQPACKET, 0, sp) == 0 && server.add_client(sp[0], sp[0]) == 1, "client");
+            std::thread serving([&] { server.run(); });
+            PIDClient client(sp[1], sp[1]);
+            client.release(client.allocate());
+            CHECK(client.finish() == 1, "finish");
+            serving.join();
+            close(sp[1]);
+        }
+        CHECK(out.str() == "[Server] client 1 request 1 asked for 8, granted 8\n"
+                           "[Server] client 1 request 2 released 8\n"
+                           "[Server] client 1 request 3 done\n", "server requests logged in order");
+    }
+
+    // 4) An idle formatter sleeps on its futex: a record logged after it
+    // went to sleep wakes it, and flush() from several threads returns.
+    {
+        std::ostringstream out;
+        pid_log::EventLog events(out);
+        usleep(20000);
+        events.exited(1, 5);
+        for (int i = 0; i < 1000 && events.logged() == 0; ++i) usleep(1000);
+        CHECK(events.logged() == 1, "a sleeping formatter is woken by the producer");
+        std::vector<std::thread> flushers;
+        for (std::uint32_t t = 0; t < 3; ++t) {
+            flushers.emplace_back([&events, t] {
+                for (std::uint32_t i = 0; i < 100; ++i) {
+                    events.request(t + 1, i, pid_protocol::kDone, 0);
+                    events.flush();
+                }
+            });
+        }
+        for (std::thread& f : flushers) f.join();
+        CHECK(events.logged() == 301 && lines(out.str()) == 301, "every flush returned with its records out");
+    }
+
+    std::cout << "  ✓ binary event log: lock-free ring, background formatting, sampling and levels\n\n";
+}
+
 int main() {
     requirement_tests();
     what_if_tests();
+    sparse_storage_tests();
+    successor_tests();
+    simd_scan_tests();
+    resize_tests();
+    hole_tests();
+    pool_tests();
+    namespace_tests();
+    metadata_tests();
+    owner_index_tests();
+    reservation_tests();
+    atomic_tests();
+    lease_tests();
+    process_tree_tests();
+    zombie_tests();
+    limit_group_tests();
+    protocol_tests();
+    server_tests();
+    seqpacket_tests();
+    shm_ring_tests();
+    uring_tests();
+    pipeline_tests();
+    client_tests();
+    push_tests();
+    reclaim_tests();
+    log_tests();
     std::cout << "All PID manager tests completed successfully." << std::endl;
     return 0;
 }
@@ -0,0 +1,173 @@
+#pragma once
+#include <vector>
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include "pid_manager.hpp"
+
+// Bitwise trie of bitmaps (a 64-ary van Emde Boas layout) for 2^32-scale
+// PID spaces.
+//
+// The leaf level is a packed bitmap of allocated slots. Above it sit two
+// summary hierarchies, each level holding one bit per word of the level
+// below:
+//   full_[l] - the word below is all ones   (used by find_clear)
+//   any_[l]  - the word below is non-zero   (used by find_set)
+// A successor query walks up from the starting word until a summary word
+// has a candidate bit, then descends with one count-trailing-zeros per level.
+// That is O(log64 U): 6 levels at U = 2^32, independent of the fill ratio.
+//
+// Bits of full_ that stand for words past the end of the level below are
+// kept set, so the search never descends into a word that doesn't exist.
+class TrieStorage {
+public:
+    void reset(std::size_t n) {
+        leaf_.clear();
+        full_.clear();
+        any_.clear();
+        resize(n);
+    }
+
+    // Growing only recomputes the summary bits that cover new words (plus
+    // the old last word, whose padding changes), so it is amortized O(1)
+    // per new slot. New levels are added on top as the leaf count grows.
+    void resize(std::size_t n) {
+        std::size_t below = words_for(n);
+        std::size_t old_below = leaf_.size();
+        resize_amortized(leaf_, below);
+        std::size_t l = 0;
+        for (; below > 1; ++l) {
+            std::size_t count = words_for(below);
+            if (l == full_.size()) {
+                full_.emplace_back();
+                any_.emplace_back();
+                old_below = 0;
+            }
+            std::size_t old_count = full_[l].size();
+            resize_amortized(full_[l], count);
+            resize_amortized(any_[l], count);
+            std::size_t first = std::min(old_below, below);
+            if (first > 0) --first;
+            for (std::size_t pos = first; pos < count * 64; ++pos) {
+                bool full = true, any = false;
+                if (pos < below) {
+                    full = (l == 0 ? leaf_[pos] : full_[l - 1][pos]) == ~std::uint64_t(0);
+                    any = (l == 0 ? leaf_[pos] : any_[l - 1][pos]) != 0;
+                }
+                assign(full_[l][pos >> 6], pos, full);
+                assign(any_[l][pos >> 6], pos, any);
+            }
+            old_below = old_count;
+            below = count;
+        }
+        full_.resize(l);
+        any_.resize(l);
+    }
+
+    bool test(std::size_t slot) const { return (leaf_[slot >> 6] >> (slot & 63)) & 1u; }
+
+    void set(std::size_t slot) {
+        std::uint64_t& word = leaf_[slot >> 6];
+        bool was_empty = word == 0;
+        word |= bit(slot);
+        bool filled = word == ~std::uint64_t(0);
+
+        std::size_t j = slot >> 6;
+        for (std::size_t l = 0; filled && l < full_.size(); ++l, j >>= 6) {
+            std::uint64_t& s = full_[l][j >> 6];
+            s |= bit(j);
+            filled = s == ~std::uint64_t(0);
+        }
+        j = slot >> 6;
+        for (std::size_t l = 0; was_empty && l < any_.size(); ++l, j >>= 6) {
+            std::uint64_t& s = any_[l][j >> 6];
+            was_empty = s == 0;
+            s |= bit(j);
+        }
+    }
+
+    void clear(std::size_t slot) {
+        std::uint64_t& word = leaf_[slot >> 6];
+        bool was_full = word == ~std::uint64_t(0);
+        word &= ~bit(slot);
+        bool emptied = word == 0;
+
+        std::size_t j = slot >> 6;
+        for (std::size_t l = 0; was_full && l < full_.size(); ++l, j >>= 6) {
+            std::uint64_t& s = full_[l][j >> 6];
+            was_full = s == ~std::uint64_t(0);
+            s &= ~bit(j);
+        }
+        j = slot >> 6;
+        for (std::size_t l = 0; emptied && l < any_.size(); ++l, j >>= 6) {
+            std::uint64_t& s = any_[l][j >> 6];
+            s &= ~bit(j);
+            emptied = s == 0;
+        }
+    }
+
+    std::size_t find_clear(std::size_t from, std::size_t to) const {
+        if (from >= to) return to;
+        std::size_t slot = search(from, full_, ~std::uint64_t(0));
+        return slot < to ? slot : to;
+    }
+
+    std::size_t find_set(std::size_t from, std::size_t to) const {
+        if (from >= to) return to;
+        std::size_t slot = search(from, any_, 0);
+        return slot < to ? slot : to;
+    }
+
+    std::size_t take_clear(std::size_t from, std::size_t to, std::size_t count, std::size_t* out) {
+        std::size_t taken = 0;
+        for (std::size_t slot = find_clear(from, to); slot < to && taken < count;
+             slot = find_clear(slot + 1, to)) {
+            set(slot);
+            out[taken++] = slot;
+        }
+        return taken;
+    }
+
+    std::size_t levels() const { return full_.size() + 1; }
+
+private:
+    static constexpr std::size_t npos = static_cast<std::size_t>(-1);
+
+    static std::size_t words_for(std::size_t bits) { return (bits + 63) / 64; }
+    static std::uint64_t bit(std::size_t i) { return std::uint64_t(1) << (i & 63); }
+    static void assign(std::uint64_t& word, std::size_t i, bool value) {
+        if (value) word |= bit(i);
+        else word &= ~bit(i);
+    }
+
+    // First position >= x whose leaf bit differs from `skip`, using `summary`
+    // to jump over whole words that can't contain one.
+    std::size_t search(std::size_t x, const std::vector<std::vector<std::uint64_t>>& summary,
+                       std::uint64_t skip) const {
+        std::size_t w = x >> 6;
+        if (w >= leaf_.size()) return npos;
+        std::uint64_t hits = (leaf_[w] ^ skip) & (~std::uint64_t(0) << (x & 63));
+        std::size_t level = 0;  // 0 = leaf, l + 1 = summary[l]
+        while (hits == 0) {
+            if (level == summary.size()) return npos;
+            x = w + 1;
+            w = x >> 6;
+            if (w >= summary[level].size()) return npos;
+            hits = (summary[level][w] ^ skip) & (~std::uint64_t(0) << (x & 63));
+            ++level;
+        }
+        std::size_t pos = (w << 6) + static_cast<std::size_t>(__builtin_ctzll(hits));
+        while (level > 0) {
+            --level;
+            std::uint64_t word = level == 0 ? leaf_[pos] : summary[level - 1][pos];
+            pos = (pos << 6) + static_cast<std::size_t>(__builtin_ctzll(word ^ skip));
+        }
+        return pos;
+    }
+
+    std::vector<std::uint64_t> leaf_;
+    std::vector<std::vector<std::uint64_t>> full_;
+    std::vector<std::vector<std::uint64_t>> any_;
+};
+
+using TriePIDManager = BasicPIDManager<TrieStorage>;